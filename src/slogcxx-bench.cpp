@@ -0,0 +1,418 @@
+//////////////////////////////////////////////////////////////////////
+//
+/// \file
+/// \brief Throughput and latency benchmarks for the slogcxx hot path
+///
+/// Copyright (c) 2006 Kurt Schwehr
+///     Data Visualization Research Lab,
+/// 	Center for Coastal and Ocean Mapping
+///	University of New Hampshire.
+///	http://ccom.unh.edu
+///
+/// Every benchmark runs its statement twice.  The first run is a tight loop,
+/// which gives the ns/record.  The second times each statement on its own,
+/// which gives the p50, p99 and p999 latencies, less what reading the clock
+/// costs.  Build with optimization (make slogcxx-bench) or the numbers do
+/// not mean much.
+///
+/// Built with CONCURRENT_BOOST (make slogcxx-bench-mt), it also runs 1 to
+/// N logging threads, synchronous and async, and compares the bare SlogRing
+/// with a mutex protected deque.  Built with NLOG (make slogcxx-bench-nlog),
+/// it shows what is left of the statements when logging is compiled out.
+///
+/// usage: slogcxx-bench [-j] [-l label] [-t threads] [iterations]
+///
+///  -j  write JSON, one result per line, rather than a table
+///  -l  label every result, with a version or commit, to compare runs later
+///  -t  most threads to try (default 32)
+///
+/// Each line of the table is name, build, threads, records, ns/record,
+/// p50, p99 and p999 in ns, separated by tabs.  "-" means not measured.
+//////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <deque>
+
+#include <time.h>
+
+#include <slogcxx.h>
+
+// Like the tests, do NOT add "using namespace std;"
+
+/// Which way slogcxx was built, to tell results apart
+#if defined(NLOG)
+#define BENCH_BUILD "nlog"
+#elif defined(CONCURRENT_BOOST)
+#define BENCH_BUILD "boost"
+#else
+#define BENCH_BUILD "plain"
+#endif
+
+/// Monotonic clock in nanoseconds
+long long nanoNow() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+/// Keep the compiler from throwing away results
+volatile std::size_t sink;
+
+/// What one benchmark measured
+struct Result {
+  Result(const std::string &name, const int threads=1)
+    : name(name), threads(threads), records(0), nsPerRecord(0), haveLatency(false), p50(0), p99(0), p999(0) {}
+  std::string name;	///< What was timed
+  int threads;		///< How many threads were doing it
+  long records;		///< How many times it was done
+  double nsPerRecord;	///< From the tight loop
+  bool haveLatency;	///< Were the statements timed one by one?
+  long long p50;	///< Median ns for one statement
+  long long p99;	///< 99th percentile
+  long long p999;	///< 99.9th percentile
+};
+
+/// Writes results as a table or as JSON lines
+class Reporter {
+public:
+  Reporter(const bool json, const std::string &label) : json(json), label(label) {
+    if (!json) std::cout << "# name\tbuild\tthreads\trecords\tns/record\tp50\tp99\tp999" << std::endl;
+  }
+  void report(const Result &r) {
+    if (json) {
+      std::cout << "{\"name\":\"" << quote(r.name) << "\",\"build\":\"" BENCH_BUILD "\",\"label\":\"" << quote(label)
+                << "\",\"threads\":" << r.threads << ",\"records\":" << r.records
+                << ",\"ns_per_record\":" << r.nsPerRecord;
+      if (r.haveLatency) std::cout << ",\"p50_ns\":" << r.p50 << ",\"p99_ns\":" << r.p99 << ",\"p999_ns\":" << r.p999;
+      std::cout << "}" << std::endl;
+      return;
+    }
+    std::cout << r.name << "\t" BENCH_BUILD "\t" << r.threads << "\t" << r.records << "\t" << r.nsPerRecord;
+    if (r.haveLatency) std::cout << "\t" << r.p50 << "\t" << r.p99 << "\t" << r.p999 << std::endl;
+    else std::cout << "\t-\t-\t-" << std::endl;
+  }
+private:
+  /// Escape str for a JSON string
+  static std::string quote(const std::string &str) {
+    std::string out;
+    for (std::size_t i=0;i<str.size();i++) {
+      if ('"'==str[i] || '\\'==str[i]) out += '\\';
+      out += str[i];
+    }
+    return out;
+  }
+  bool json;		///< JSON lines rather than a table
+  std::string label;	///< Goes with every result
+};
+
+/// What reading the clock twice costs, taken off every latency sample
+long long clockOverhead = 0;
+
+/// The median of a lot of back to back clock reads
+long long measureClockOverhead() {
+  std::vector<long long> samples(100000);
+  for (std::size_t i=0;i<samples.size();i++) {
+    const long long start = nanoNow();
+    samples[i] = nanoNow()-start;
+  }
+  std::sort(samples.begin(),samples.end());
+  return samples[samples.size()/2];
+}
+
+/// Fill in the latencies from samples, which get sorted
+void percentiles(std::vector<long long> &samples, Result &r) {
+  if (samples.empty()) return;
+  std::sort(samples.begin(),samples.end());
+  const std::size_t n = samples.size();
+  r.p50 = samples[std::min(n-1, n/2)];
+  r.p99 = samples[std::min(n-1, n*99/100)];
+  r.p999 = samples[std::min(n-1, n*999/1000)];
+  r.haveLatency = true;
+}
+
+/// Run Op count times, timing each one into samples if it is not null
+template <void (*Op)(Slog &, const long)>
+void loop(Slog *log, const long count, std::vector<long long> *samples) {
+  if (!samples) {
+    for (long i=0;i<count;i++) Op(*log,i);
+    return;
+  }
+  samples->resize(count);
+  for (long i=0;i<count;i++) {
+    const long long start = nanoNow();
+    Op(*log,i);
+    const long long ns = nanoNow()-start-clockOverhead;
+    (*samples)[i] = 0<ns ? ns : 0;
+  }
+}
+
+/// Time iterations of Op, split over threads
+template <void (*Op)(Slog &, const long)>
+void measure(Reporter &reporter, const char *name, Slog &log, const long iterations, const int threads=1) {
+  Result r(name,threads);
+  const long each = iterations/threads;
+  r.records = each*threads;
+  std::vector<std::vector<long long> > samples(threads);
+  for (int timed=0;timed<2;timed++) {
+    const long long start = nanoNow();
+#ifdef CONCURRENT_BOOST
+    if (1<threads) {
+      boost::thread_group group;
+      for (int t=0;t<threads;t++) group.create_thread(boost::bind(loop<Op>,&log,each,timed ? &samples[t] : 0));
+      group.join_all();
+    } else
+#endif
+      loop<Op>(&log,each,timed ? &samples[0] : 0);
+    log.flush(); // Async records count when they are written
+    if (!timed) r.nsPerRecord = double(nanoNow()-start)/r.records;
+  }
+  std::vector<long long> all;
+  for (int t=0;t<threads;t++) all.insert(all.end(),samples[t].begin(),samples[t].end());
+  percentiles(all,r);
+  reporter.report(r);
+}
+
+/// Counts records and throws them away, so the sinks are not what gets measured
+class CountingSink : public SlogSink {
+public:
+  CountingSink() : SlogSink(FORMAT_TEXT), count(0) {}
+  void write(UNUSED const int lvl, const std::string &text) {count++; sink += text.size();}
+  long count;
+};
+
+/// A Slog at TERSE that only writes to sink, with time stamps and locations on
+void quietLog(Slog &log, SlogSink *sink) {
+  log.removeSink(log.getConsoleSink());
+  log.setLevel(TERSE);
+  log.setMsgLevel(TERSE);
+  log.addSink(sink);
+}
+
+//////////////////////////////////////////////////////////////////////
+// The statements being timed.  i keeps the values changing.
+//////////////////////////////////////////////////////////////////////
+
+void opDisabledSlog(Slog &log, const long i) {SLOG(log,BOMBASTIC) << "not logged " << i << endl;}
+void opDisabledStream(Slog &log, const long i) {log << SDEBUG << "not logged " << i << endl;}
+void opEntry(Slog &log, UNUSED const long i) {log.entry(TERSE,"a message with nothing to format");}
+void opChain(Slog &log, const long i) {log << TERSE << "value " << i << " of " << 1000 << " is " << i*0.5 << endl;}
+void opInt(Slog &log, const long i) {log << TERSE << int(i) << endl;}
+void opUnsigned(Slog &log, const long i) {log << TERSE << unsigned(i) << endl;}
+void opLongLong(Slog &log, const long i) {log << TERSE << -1000000000000LL*i << endl;}
+void opUnsignedLongLong(Slog &log, const long i) {log << TERSE << 1000000000000ULL*i << endl;}
+void opDouble(Slog &log, const long i) {log << TERSE << i*1.1 << endl;}
+void opFloat(Slog &log, const long i) {log << TERSE << i*1.1f << endl;}
+void opWhere(Slog &log, UNUSED const long i) {log << TERSE << WHERE << "here" << endl;}
+void opLogState(Slog &log, UNUSED const long i) {LogState state(&log,"inner");}
+
+#if !defined(NLOG)
+//////////////////////////////////////////////////////////////////////
+// Number formatting on its own
+//////////////////////////////////////////////////////////////////////
+
+/// Time the old way: a stringstream per value
+template <typename T>
+void benchStringstream(Reporter &reporter, const char *name, const T *values, const int count, const long iterations) {
+  Result r(std::string(name)+" stringstream");
+  r.records = iterations;
+  const long long start = nanoNow();
+  for (long i=0;i<iterations;i++) {
+    std::stringstream sstr;
+    sstr << values[i%count];
+    sink += sstr.str().size();
+  }
+  r.nsPerRecord = double(nanoNow()-start)/iterations;
+  reporter.report(r);
+}
+
+/// Time the new way: format straight into a buffer on the stack
+template <typename T>
+void benchFormat(Reporter &reporter, const char *name, std::size_t (*format)(char *, T), const T *values,
+                 const int count, const long iterations) {
+  Result r(std::string(name)+" slogFormat");
+  r.records = iterations;
+  char buf[SLOG_NUMBER_BUFSIZE];
+  const long long start = nanoNow();
+  for (long i=0;i<iterations;i++) sink += format(buf,values[i%count]);
+  r.nsPerRecord = double(nanoNow()-start)/iterations;
+  reporter.report(r);
+}
+#endif
+
+#if defined(CONCURRENT_BOOST) && !defined(NLOG)
+//////////////////////////////////////////////////////////////////////
+// The queue on its own
+//////////////////////////////////////////////////////////////////////
+
+/// Push count items into the ring, waiting whenever it is full
+void ringProducer(SlogRing<long> *ring, const long count) {
+  for (long i=0;i<count;i++) {
+    SlogRing<long>::Cell *cell;
+    while (!(cell = ring->claimPush())) boost::this_thread::yield();
+    cell->data = i;
+    ring->publish(cell);
+  }
+}
+
+/// Many producers, one consumer, no locks
+void benchRing(Reporter &reporter, const int producers, const long items) {
+  Result r("SlogRing",producers);
+  SlogRing<long> ring(4096);
+  const long each = items/producers;
+  r.records = each*producers;
+  const long long start = nanoNow();
+  boost::thread_group threads;
+  for (int p=0;p<producers;p++) threads.create_thread(boost::bind(ringProducer,&ring,each));
+  for (long got=0; got<r.records; ) {
+    SlogRing<long>::Cell *cell = ring.claimPop();
+    if (!cell) {boost::this_thread::yield(); continue;}
+    sink += cell->data;
+    ring.release(cell);
+    got++;
+  }
+  threads.join_all();
+  r.nsPerRecord = double(nanoNow()-start)/r.records;
+  reporter.report(r);
+}
+
+/// What the async queue used to be
+struct LockedQueue {
+  boost::mutex mutex;
+  std::deque<long> queue;
+};
+
+/// Push count items into the locked queue, waiting whenever it is full
+void lockedProducer(LockedQueue *q, const long count) {
+  for (long i=0;i<count;) {
+    boost::mutex::scoped_lock lock(q->mutex);
+    if (q->queue.size()>=4096) {lock.unlock(); boost::this_thread::yield(); continue;}
+    q->queue.push_back(i++);
+  }
+}
+
+/// Many producers, one consumer, one mutex
+void benchLocked(Reporter &reporter, const int producers, const long items) {
+  Result r("mutex+deque",producers);
+  LockedQueue q;
+  const long each = items/producers;
+  r.records = each*producers;
+  const long long start = nanoNow();
+  boost::thread_group threads;
+  for (int p=0;p<producers;p++) threads.create_thread(boost::bind(lockedProducer,&q,each));
+  for (long got=0; got<r.records; ) {
+    boost::mutex::scoped_lock lock(q.mutex);
+    if (q.queue.empty()) {lock.unlock(); boost::this_thread::yield(); continue;}
+    sink += q.queue.front();
+    q.queue.pop_front();
+    got++;
+  }
+  threads.join_all();
+  r.nsPerRecord = double(nanoNow()-start)/r.records;
+  reporter.report(r);
+}
+#endif
+
+static void usage(const char *name) {
+  std::cerr << "usage: " << name << " [-j] [-l label] [-t threads] [iterations]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  std::string label;
+  long iterations = 200000;
+  UNUSED int maxThreads = 32;
+  for (int arg=1; arg<argc; arg++) {
+    if (!strcmp(argv[arg],"-j")) json = true;
+    else if (!strcmp(argv[arg],"-l") && arg+1<argc) label = argv[++arg];
+    else if (!strcmp(argv[arg],"-t") && arg+1<argc) maxThreads = atoi(argv[++arg]);
+    else if ('-'!=argv[arg][0] && 0<atol(argv[arg])) iterations = atol(argv[arg]);
+    else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  Reporter reporter(json,label);
+  clockOverhead = measureClockOverhead();
+
+#if !defined(NLOG)
+  const int count = 8;
+  const long long ints[count] = {0, 7, -42, 1234, -98765, 2147483647LL, -9223372036854775807LL, 31337};
+  const unsigned long long uints[count] = {0, 7, 42, 1234, 98765, 4294967295ULL, 18446744073709551615ULL, 31337};
+  const double doubles[count] = {0., 5.2, -1.5, 3.14159265358979, 1e-9, 6.02214076e23, 1./3., 123456.789};
+  const float floats[count] = {0.f, 4.1f, -1.5f, 3.14159f, 1e-9f, 6.022e23f, 1.f/3.f, 123456.789f};
+
+  benchStringstream(reporter,"int",ints,count,iterations);
+  benchFormat<long long>(reporter,"int",slogFormatSigned,ints,count,iterations);
+  benchStringstream(reporter,"unsigned",uints,count,iterations);
+  benchFormat<unsigned long long>(reporter,"unsigned",slogFormatUnsigned,uints,count,iterations);
+  benchStringstream(reporter,"double",doubles,count,iterations);
+  benchFormat<double>(reporter,"double",slogFormatDouble,doubles,count,iterations);
+  benchStringstream(reporter,"float",floats,count,iterations);
+  benchFormat<float>(reporter,"float",slogFormatFloat,floats,count,iterations);
+#endif
+
+  {
+    // Whole statements, with the sink taken out of the picture
+    Slog log("","",false,false,true,true);
+    quietLog(log,new CountingSink);
+    measure<opDisabledSlog>(reporter,"disabled SLOG",log,iterations);
+    measure<opDisabledStream>(reporter,"disabled << SDEBUG",log,iterations);
+    measure<opDisabledSlog>(reporter,"disabled SLOG, named logger",log.getLogger("bench.named"),iterations);
+    measure<opEntry>(reporter,"entry",log,iterations);
+    measure<opEntry>(reporter,"entry, named logger",log.getLogger("bench.named"),iterations);
+    measure<opChain>(reporter,"<< chain",log,iterations);
+    measure<opInt>(reporter,"<< int",log,iterations);
+    measure<opUnsigned>(reporter,"<< unsigned",log,iterations);
+    measure<opLongLong>(reporter,"<< long long",log,iterations);
+    measure<opUnsignedLongLong>(reporter,"<< unsigned long long",log,iterations);
+    measure<opDouble>(reporter,"<< double",log,iterations);
+    measure<opFloat>(reporter,"<< float",log,iterations);
+    measure<opWhere>(reporter,"<< WHERE",log,iterations);
+    std::vector<LogState*> scopes;
+    for (int depth=0;depth<32;depth++) scopes.push_back(new LogState(&log,"scope"));
+    measure<opEntry>(reporter,"entry 32 scopes deep",log,iterations);
+    measure<opLogState>(reporter,"LogState 32 scopes deep",log,iterations);
+    while (!scopes.empty()) {
+      delete scopes.back();
+      scopes.pop_back();
+    }
+  }
+  {
+    Slog log("","",false,false,true,true);
+    quietLog(log,new SlogFileSink("bench-xml.log",false,FORMAT_XML));
+    measure<opEntry>(reporter,"entry XML file",log,iterations);
+  }
+  {
+    Slog log("","",false,false,true,true);
+    quietLog(log,new SlogFileSink("bench-text.log",false,FORMAT_TEXT));
+    measure<opEntry>(reporter,"entry text file",log,iterations);
+  }
+
+#ifdef CONCURRENT_BOOST
+  for (int threads=1; threads<=maxThreads; threads*=2) {
+    {
+      Slog log("","",false,false,true,true);
+      quietLog(log,new CountingSink);
+      measure<opChain>(reporter,"<< chain sync",log,iterations,threads);
+    }
+    {
+      Slog log("","",false,false,true,true);
+      quietLog(log,new CountingSink);
+      log.enableAsync(4096);
+      measure<opChain>(reporter,"<< chain async",log,iterations,threads);
+    }
+#if !defined(NLOG)
+    benchRing(reporter,threads,iterations);
+    benchLocked(reporter,threads,iterations);
+#endif
+  }
+#endif
+  return EXIT_SUCCESS;
+}
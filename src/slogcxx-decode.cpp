@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////
+//
+/// \file
+/// \brief Turn a binary slogcxx log back into text or XML
+///
+/// Copyright (c) 2006 Kurt Schwehr
+///     Data Visualization Research Lab,
+/// 	Center for Coastal and Ocean Mapping
+///	University of New Hampshire.
+///	http://ccom.unh.edu
+///
+/// A FORMAT_BINARY sink skips all of the formatting while the program
+/// runs.  This does that formatting afterwards, with SlogDecoder, and
+/// writes what a text, console or XML sink would have written.
+///
+/// usage: slogcxx-decode [-t|-c|-x] [-i] [-s indent] [file ...]
+///
+///  -t  text, like a log file without XML (the default)
+///  -c  like the console
+///  -x  XML
+///  -i  ISO 8601 time stamps rather than seconds since 1970
+///  -s  indent for each scope (default " ")
+///
+/// With no files, it reads standard input.
+//////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include <slogcxx.h>
+
+/// Decode one stream to standard out.  @return false if it is damaged
+static bool decodeStream(std::istream &in, SlogDecoder &decoder) {
+	static char buf[65536];
+	std::string out;
+	while (in.read(buf, sizeof(buf)) || 0<in.gcount()) {
+		const bool ok = decoder.decode(buf, in.gcount(), out);
+		std::cout << out;
+		out.clear();
+		if (!ok) return false;
+	}
+	decoder.finish(out);
+	std::cout << out;
+	return true;
+}
+
+static void usage(const char *name) {
+	std::cerr << "usage: " << name << " [-t|-c|-x] [-i] [-s indent] [file ...]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	SlogSinkFormat format = FORMAT_TEXT;
+	SlogTimeFormat timeFormat = TIME_EPOCH_MICROS;
+	std::string indent(" ");
+	int arg = 1;
+	for (; arg<argc && '-'==argv[arg][0] && argv[arg][1]; arg++) {
+		if (!strcmp(argv[arg],"-t")) format = FORMAT_TEXT;
+		else if (!strcmp(argv[arg],"-c")) format = FORMAT_CONSOLE;
+		else if (!strcmp(argv[arg],"-x")) format = FORMAT_XML;
+		else if (!strcmp(argv[arg],"-i")) timeFormat = TIME_ISO8601;
+		else if (!strcmp(argv[arg],"-s") && arg+1<argc) indent = argv[++arg];
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	bool ok = true;
+	if (arg==argc) {
+		SlogDecoder decoder(format, timeFormat, indent);
+		if (!decodeStream(std::cin, decoder)) {
+			std::cerr << argv[0] << ": standard input is not a good slogcxx binary log" << std::endl;
+			ok = false;
+		}
+	}
+	for (; arg<argc; arg++) {
+		std::ifstream in(argv[arg], std::ios::in | std::ios::binary);
+		if (!in.is_open()) {
+			std::cerr << argv[0] << ": unable to open " << argv[arg] << std::endl;
+			ok = false;
+			continue;
+		}
+		SlogDecoder decoder(format, timeFormat, indent); // Each file starts fresh
+		if (!decodeStream(in, decoder)) {
+			std::cerr << argv[0] << ": " << argv[arg] << " is not a good slogcxx binary log" << std::endl;
+			ok = false;
+		}
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
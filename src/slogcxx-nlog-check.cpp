@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////
+//
+/// \file
+/// \brief Shows that with NLOG, log statements leave nothing behind
+///
+/// Copyright (c) 2006 Kurt Schwehr
+///     Data Visualization Research Lab,
+/// 	Center for Coastal and Ocean Mapping
+///	University of New Hampshire.
+///	http://ccom.unh.edu
+///
+/// make slogcxx-nlog-check builds this twice with NLOG, once with the log
+/// statements (SLOG_CHECK_STATEMENTS) and once without, and fails unless
+/// the two disassemble to exactly the same code.  Every kind of statement
+/// should be in here, with operands that have no side effects.
+//////////////////////////////////////////////////////////////////////
+
+#include <slogcxx.h>
+
+/// Something of our own to log
+struct CheckPoint {
+  double x; ///< Easting
+  double y; ///< Northing
+};
+
+/// How operator<< would log a CheckPoint
+template <> struct SlogTraits<CheckPoint> : SlogInsertable {
+  /// Write as (x,y)
+  static void format(SlogBuffer &buf, const CheckPoint &p) {
+    buf.append('(');
+    buf.appendDouble(p.x);
+    buf.append(',');
+    buf.appendDouble(p.y);
+    buf.append(')');
+  }
+};
+
+/// Add up values, with logging all through it
+double checkSum(UNUSED Slog &log, const double *values, const int count) {
+#ifdef SLOG_CHECK_STATEMENTS
+  LogState scope(&log,"checkSum");
+  log << TERSE << WHERE << "adding up " << count << " values" << endl;
+  log.entry(VERBOSE,"starting");
+#endif
+  double total = 0;
+  for (int i=0;i<count;i++) {
+#ifdef SLOG_CHECK_STATEMENTS
+    log << SDEBUG << "value " << i << " is " << values[i] << " running total " << total << endl;
+    log << incl << "unsigned " << unsigned(i) << " long long " << 1000000000000LL*i << decl << endl;
+    SLOG(log,BOMBASTIC) << "squared " << values[i]*values[i] << endl;
+    SLOG_RATE(log,TERSE,10) << "rate " << i << endl;
+    SLOG_SAMPLE(log,TERSE,100) << "sample " << i << endl;
+    const CheckPoint p = {values[i],total};
+    log << SINFO << "point " << p << ' ' << float(total) << ' ' << (0<i) << endl;
+#endif
+    total += values[i];
+  }
+#ifdef SLOG_CHECK_STATEMENTS
+  log.pushState("finishing",TRACE);
+  log << "total " << total << " mean " << total/count << endl;
+  log.partial(TRACE,"partial ");
+  log.partial(TRACE,"more",4);
+  log.complete();
+  log.writeState();
+  log.popState();
+  scope.pop();
+#endif
+  return total;
+}
+
+/// A Slog of its own, made and thrown away
+int checkLocal(const int n) {
+#ifdef SLOG_CHECK_STATEMENTS
+  Slog log("check.log"," ",false,true,false);
+  log.setLevel(BOMBASTIC);
+  LogState scope(&log,"checkLocal",TERSE);
+  log << SWARNING << "n is " << n << endl;
+#endif
+  return n*n+1;
+}
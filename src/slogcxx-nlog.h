@@ -7,7 +7,13 @@
 //	http://ccom.unh.edu
 //
 /// @file
-/// @brief Stripped down version that tries to dissapear at compile time
+/// @brief Stripped down version that disappears at compile time
+///
+/// Every log statement, LogState included, compiles to nothing, which
+/// slogcxx-nlog-check checks by comparing object code.  The operands of
+/// << are still evaluated as C++ requires, so one with side effects (a
+/// function call that does I/O, say) still runs.  The optimizer drops the
+/// rest.  Put statements like that in SLOG(), which never evaluates them.
 ///
 //////////////////////////////////////////////////////////////////////
 
@@ -18,120 +24,199 @@
 // MACROS 
 //////////////////////////////////////////////////////////////////////
 
-// FIX: Put a NOP in the stream?
-//#define WHERE Where(__FILE__,__LINE__,__FUNCTION__)
-// Patterned after assert.h.  Will this work?
 #undef WHERE
-//#define WHERE ((void)0)
-#define WHERE (0)
+#define WHERE (Where())
 
 //////////////////////////////////////////////////////////////////////
 // Where class
 //////////////////////////////////////////////////////////////////////
 
-// class Where {
-//  public: 
-//     Where(UNUSED const std::string &_file, UNUSED const int &_lineno, UNUSED const std::string &_function) {};
-//     inline std::string getFile() const {return std::string("unknown file");};
-//     inline int getLineno() const {return -1;};
-//     inline std::string getFunction() const {return std::string("unknown function");};
-// };
-
 class Where {
  public: 
-    Where(UNUSED const std::string &_file, UNUSED const int &_lineno, UNUSED const std::string &_function) {}
-    inline std::string const &getFile() const {
-	static const std::string unknownFile("unknown file");
-	return unknownFile;
-    }
-    inline int const &getLineno() const {
-	static const int unknownLine=-1;
-	return unknownLine;
-    }
-    inline std::string const &getFunction() const {
-	static const std::string unknownFunction("unknown function");
-	return unknownFunction;
-    }
+    Where() {}
+    Where(UNUSED const char *_file, UNUSED const int _lineno, UNUSED const char *_function) {}
+    const char *getFile() const {return "unknown file";}
+    int getLineno() const {return -1;}
+    const char *getFunction() const {return "unknown function";}
 };
 
 
 
+//////////////////////////////////////////////////////////////////////
+// Sinks
+//////////////////////////////////////////////////////////////////////
+
+class SlogSink {
+public:
+    SlogSink(const SlogSinkFormat format, const int level=NEVER) : format(format), level(level) {}
+    virtual ~SlogSink() {}
+    virtual void write(UNUSED const int lvl, UNUSED const std::string &text) {}
+    virtual void flush() {}
+    virtual bool pending() const {return false;}
+    virtual void setFlushPolicy(UNUSED const size_t bytes, UNUSED const double seconds, UNUSED const int level) {}
+    virtual void crashFlush() {}
+    virtual void crashWrite(UNUSED const char *text, UNUSED const size_t len) {}
+    virtual void crashClose() {}
+    SlogSinkFormat getFormat() const {return format;}
+    void setFormat(const SlogSinkFormat f) {format=f;}
+    int getLevel() const {return level;}
+    void setLevel(const int lvl) {level=lvl;}
+private:
+    SlogSinkFormat format;
+    int level;
+};
+
+class SlogConsoleSink : public SlogSink {
+public:
+    SlogConsoleSink(UNUSED std::ostream &out=std::cerr, const SlogSinkFormat format=FORMAT_CONSOLE, const int level=NEVER)
+	: SlogSink(format,level) {}
+};
+
+class SlogFileSink : public SlogSink {
+public:
+    SlogFileSink(UNUSED const std::string &filename, UNUSED const bool append=true,
+		 const SlogSinkFormat format=FORMAT_XML, const int level=NEVER)
+	: SlogSink(format,level) {}
+    bool isOpen() const {return false;}
+    void setRotation(UNUSED const size_t bytes, UNUSED const double seconds=0, UNUSED const unsigned keep=5) {}
+    unsigned getRotations() const {return 0;}
+};
+
+class SlogMmapSink : public SlogSink {
+public:
+    SlogMmapSink(UNUSED const std::string &filename, UNUSED const bool append=true,
+		 const SlogSinkFormat format=FORMAT_XML, const int level=NEVER, UNUSED const size_t chunkSize=1<<20)
+	: SlogSink(format,level) {}
+    bool isOpen() const {return false;}
+    size_t size() const {return 0;}
+};
+
+#ifdef SLOGCXX_ZLIB
+class SlogGzipSink : public SlogSink {
+public:
+    SlogGzipSink(UNUSED const std::string &filename, UNUSED const bool append=true,
+		 const SlogSinkFormat format=FORMAT_XML, const int level=NEVER, UNUSED const int compression=6)
+	: SlogSink(format,level) {}
+    bool isOpen() const {return false;}
+};
+#endif
+
+class SlogMemorySink : public SlogSink {
+public:
+    SlogMemorySink(const SlogSinkFormat format=FORMAT_TEXT, const int level=NEVER, UNUSED const size_t maxRecords=0)
+	: SlogSink(format,level) {}
+    std::vector<std::string> getRecords() {return std::vector<std::string>();}
+    size_t size() {return 0;}
+    void clear() {}
+};
+
+class SlogDecoder {
+public:
+    SlogDecoder(UNUSED const SlogSinkFormat format=FORMAT_TEXT, UNUSED const SlogTimeFormat timeFormat=TIME_EPOCH_MICROS,
+		UNUSED const std::string &indentStr=" ") {}
+    bool decode(UNUSED const char *data, UNUSED const size_t len, UNUSED std::string &out) {return true;}
+    void finish(UNUSED std::string &out) {}
+};
+
 //////////////////////////////////////////////////////////////////////
 // The main Slog class
 //////////////////////////////////////////////////////////////////////
 
-// FIX: probably needs help optimizing this down
+/// \brief Does nothing and holds nothing
+///
+/// Every call is inline and empty, so a log statement leaves no code behind.  Strings
+/// are taken as templates, so a literal does not even get turned into a std::string.
+/// Nothing is tracked: the getters always answer as if the Slog had just been made.
 class Slog {
 public:
-    Slog(UNUSED const std::string &filename="", const std::string &indentStr=" ", 
-	 UNUSED const bool append=true, const bool enableXml=true, const bool enableTime=true)
-	: logLevel(1), msgLevel(1), curStr(""),
-	    xmlEnabled(enableXml), timeEnabled(enableTime)
-	    ,stateIndent(indentStr)
-    {}
-    ~Slog() {}
-
-    void setLevel(const int lvl) {logLevel=lvl;} 
-    int getLevel() {return logLevel;}
-    int inc() {return ++logLevel;}
-    int dec() {--logLevel; if (0>logLevel) logLevel=0; return logLevel;}
-    void enableTime() {timeEnabled=true;};
-    void disableTime() {timeEnabled=false;};
-    bool getTimeStatus() {return timeEnabled;};
-    void enableXml() {xmlEnabled=true;}; 
-    void disableXml() {xmlEnabled=false;};  
-    bool getXmlStatus() {return xmlEnabled;};
-    bool entry(UNUSED const int lvl, UNUSED const std::string str) {return true;}
-
-    bool where(UNUSED const std::string &file, UNUSED const int lineno, UNUSED const std::string &function) {return true;}
-
-    void setMsgLevel(const int lvl) {assert(0<=lvl);msgLevel=lvl;}
-    int getMsgLevel() {return msgLevel;}
-    int incMsg() {return ++msgLevel;}
-    int decMsg() {--msgLevel; if (0>msgLevel) msgLevel=0; return msgLevel;}
-
-    bool partial(UNUSED const int lvl, UNUSED const std::string str) {return true;} 
-    bool complete() {return true;}
-
-    void setStateIndent(const std::string &str) {stateIndent=str;};
-    std::string getStateIndent() {return stateIndent;};
-    std::string indent();
-    std::string getStateNumberStr();
-    std::string getCurScope() {if (0==getStateDepth()) return ""; return stateStack[stateStack.size()-1];}
-
-    void pushState(std::string scope, int msgLvl = -1) {
-	stateStack.push_back(scope);
-	if (msgLvl != -1) {
-	    msgLvlStack.push_back(getMsgLevel());
-	    setMsgLevel(msgLvl);
-	}  else { msgLvlStack.push_back(-1); }
-    }
-    std::string popState() {
-	std::string s=stateStack[stateStack.size()-1];
-	int ml = msgLvlStack[msgLvlStack.size()-1];
-	if (ml != -1) setMsgLevel(ml);
-	stateStack.pop_back();
-	msgLvlStack.pop_back();
-	return s;
+    Slog() {}
+    template <typename F>
+    explicit Slog(UNUSED const F &filename) {}
+    template <typename F, typename I>
+    Slog(UNUSED const F &filename, UNUSED const I &indentStr, UNUSED const bool append=true,
+	 UNUSED const bool enableXml=true, UNUSED const bool enableTime=true, UNUSED const bool enableLocation=true) {}
+
+    template <typename F>
+    void AddLogFileOutput(UNUSED const F &filename, UNUSED const bool append) {}
+    void addSink(SlogSink *sink) {delete sink;}
+    bool removeSink(UNUSED SlogSink *sink) {return false;}
+    SlogSink *getConsoleSink() {
+	static SlogConsoleSink noSink; // So getConsoleSink()->setLevel() still works
+	return &noSink;
     }
+    SlogSink *getFileSink() {return 0;}
+
+    void setLevel(UNUSED const int lvl) {}
+    int getLevel() {return 1;}
+    bool isEnabled(UNUSED const int lvl) const {return false;}
+    bool isEnabled() const {return false;}
+    int inc() {return 1;}
+    int dec() {return 1;}
+    template <typename S>
+    Slog &getLogger(UNUSED const S &name) {return *this;}
+    void inheritLevel() {}
+    std::string getName() const {return std::string();}
+    void enableTime() {}
+    void disableTime() {}
+    bool getTimeStatus() {return false;}
+    void setTimeFormat(UNUSED const SlogTimeFormat format, UNUSED const SlogClockSource clock=CLOCK_SOURCE_REALTIME) {}
+    SlogTimeFormat getTimeFormat() const {return TIME_EPOCH_MICROS;}
+    SlogClockSource getClockSource() const {return CLOCK_SOURCE_REALTIME;}
+    void enableCollapse() {}
+    void disableCollapse() {}
+    bool getCollapseStatus() const {return false;}
+    void enableXml() {}
+    void disableXml() {}
+    bool getXmlStatus() {return false;}
+    void enableLocation() {}
+    void disableLocation() {}
+    bool getLocationStatus() {return false;}
+    void enableAsync(UNUSED const std::size_t queueSize=4096, UNUSED const SlogOverflowPolicy policy=OVERFLOW_BLOCK) {}
+    void disableAsync() {}
+    bool getAsyncStatus() {return false;}
+    unsigned long getDroppedCount() {return 0;}
+    void flush() {}
+    void setFlushPolicy(size_t=65536, double=1.0, int=LACONIC) {}
+    void setRotation(UNUSED const size_t bytes, UNUSED const double seconds=0, UNUSED const unsigned keep=5) {}
+    void enableCrashHandler() {}
+    void disableCrashHandler() {}
+    void crashFlush(UNUSED const int sig) {}
+    template <typename F>
+    bool loadConfig(UNUSED const F &filename) {return true;}
+    // No SIGHUP handler either, so a SIGHUP does what it would with no Slog at all
+    template <typename F>
+    void watchConfig(UNUSED const F &filename, UNUSED const double seconds=1.0) {}
+    void unwatchConfig() {}
+    bool pollConfig() {return false;}
+
+    template <typename S>
+    bool entry(UNUSED const int lvl, UNUSED const S &str) {return false;}
+    template <typename F, typename G>
+    bool where(UNUSED const F &file, UNUSED const int lineno, UNUSED const G &function) {return false;}
+
+    void setMsgLevel(UNUSED const int lvl) {}
+    int getMsgLevel() {return 1;}
+    int incMsg() {return 1;}
+    int decMsg() {return 1;}
+
+    template <typename S>
+    bool partial(UNUSED const int lvl, UNUSED const S &str) {return false;}
+    bool partial(UNUSED const int lvl, UNUSED const char *str, UNUSED const std::size_t len) {return false;}
+    bool complete() {return false;}
+
+    template <typename S>
+    void setStateIndent(UNUSED const S &str) {}
+    std::string getStateIndent() {return std::string();}
+    std::string indent() const {return std::string();}
+    std::string getStateNumberStr() const {return std::string();}
+    std::string getCurScope() const {return std::string();}
+    template <typename S>
+    void pushState(UNUSED const S &scope, UNUSED int msgLvl = -1) {}
+    std::string popState() {return std::string();}
     void writeState(UNUSED bool flat=true) {}
-    int getStateDepth() {return stateStack.size();};
+    int getStateDepth() {return 0;}
 
-    Slog& operator=(UNUSED const Slog& rhs) {
-	std::cerr << "Slog op=!" << std::endl;
-	return *this;
-    }
-
-private:
-    int logLevel;
-    int msgLevel;
-    std::string curStr;
-    bool xmlEnabled;
-    bool timeEnabled;
-
-    std::string stateIndent;
-    std::vector<std::string> stateStack;
-    std::vector<int> msgLvlStack;
+    void SetLocation(UNUSED const Where &w) {}
 }; // end Slog class
 
 
@@ -141,26 +226,28 @@ inline Slog& endl(Slog& s) {return s;}
 inline Slog& decl(Slog& s) {return s;}
 inline Slog& incl(Slog& s) {return s;}
 
-inline Slog& operator<< (Slog &s, UNUSED const int &r){return s;} 
-inline Slog& operator<< (Slog &s, UNUSED const size_t &r){return s;} 
-inline Slog& operator<< (Slog &s, UNUSED const char *str){return s;}
-inline Slog& operator<< (Slog &s, UNUSED const std::string &str){return s;}
-
-inline Slog& operator<< (Slog &s, UNUSED const char &c){return s;} 
-inline Slog& operator<< (Slog &s, UNUSED const short &sh){return s;}
-inline Slog& operator<< (Slog &s, UNUSED const long &l){return s;} 
-inline Slog& operator<< (Slog &s, UNUSED const float &f){return s;} 
-inline Slog& operator<< (Slog &s, UNUSED const double &d){return s;}
+// Same interface as the real one so that SlogTraits specializations still compile
+class SlogBuffer {
+public:
+    explicit SlogBuffer(UNUSED std::string &message) {}
+    void append(UNUSED const char *str, UNUSED const std::size_t len) {}
+    void append(UNUSED const char *str) {}
+    void append(UNUSED const std::string &str) {}
+    void append(UNUSED const char c) {}
+    void appendSigned(UNUSED const SlogLongLong v) {}
+    void appendUnsigned(UNUSED const SlogULongLong v) {}
+    void appendDouble(UNUSED const double v) {}
+    void appendFloat(UNUSED const float v) {}
+};
 
-inline Slog& operator<< (Slog &s, UNUSED const Where &w){return s;}
+// Numbers, strings, levels, WHERE and anything else
+template <typename T>
+inline Slog& operator<< (Slog &s, UNUSED const T &v){return s;}
 
 
 class LogState {
 public:
-    LogState(Slog *logInstance, const std::string &scope, int msgLvl = -1): log(logInstance), popped(false) {log->pushState(scope,msgLvl);}
-    inline std::string pop() {  if (popped) return "";  popped=true; return log->popState();}
-    ~LogState() {}
-private:
-    Slog *log;
-    bool popped;
+    template <typename S>
+    LogState(UNUSED Slog *logInstance, UNUSED const S &scope, UNUSED int msgLvl = -1) {}
+    std::string pop() {return std::string();}
 };
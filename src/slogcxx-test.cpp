@@ -13,10 +13,23 @@
 //////////////////////////////////////////////////////////////////////
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <algorithm>
+#include <iterator>
 #include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <csignal>
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 #include <slogcxx.h>
+#ifdef SLOGCXX_ZLIB
+#include <zlib.h>
+#endif
 
 // For testing do NOT add "using namespace std;"!!  By not doing this, we can tell better what is going on
 
@@ -48,6 +61,27 @@
 //#define FAILED_HERE std::cerr << "Hello\n";
 #define FAILED_HERE std::cerr << __FILE__ << ":" << __LINE__ << ": error: failed in function " << __FUNCTION__<< std::endl;
 
+/// Keep the console of l quiet, and hand back a new memory sink on it to check what gets logged
+SlogMemorySink *quietLog(Slog &l, UNUSED const SlogSinkFormat format=FORMAT_TEXT, UNUSED const int level=NEVER,
+                         UNUSED const size_t maxRecords=0) {
+  l.getConsoleSink()->setLevel(ALWAYS);
+#ifndef NLOG
+  SlogMemorySink *mem = new SlogMemorySink(format,level,maxRecords);
+  l.addSink(mem);
+  return mem;
+#else
+  static SlogMemorySink noSink; // addSink() would delete it, and the tests still call it
+  return &noSink;
+#endif
+}
+
+/// An assert about what the Slog has kept track of.  NLOG keeps nothing, so there only the calls get a workout.
+#ifndef NLOG
+#define STATE_ASSERT(expr) assert(expr)
+#else
+#define STATE_ASSERT(expr)
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // Test functions
 //////////////////////////////////////////////////////////////////////
@@ -140,41 +174,41 @@ bool testScopeWithMsgLvl() {
 
   l.setMsgLevel(TRACE);
   l << "No" << endl;
-  assert(TRACE == l.getMsgLevel());
+  STATE_ASSERT(TRACE == l.getMsgLevel());
 
     l.pushState("1",TERSE);
     l << "Yes" << endl;
-    assert(TERSE == l.getMsgLevel());
+    STATE_ASSERT(TERSE == l.getMsgLevel());
     l.popState();
   l << "No" << endl;
-  assert(TRACE == l.getMsgLevel());
+  STATE_ASSERT(TRACE == l.getMsgLevel());
 
   l.incMsg();
-  assert(VERBOSE == l.getMsgLevel());
+  STATE_ASSERT(VERBOSE == l.getMsgLevel());
 
     l.pushState("1",BOMBASTIC);
     l << "No" << endl;
-    assert(BOMBASTIC == l.getMsgLevel());
+    STATE_ASSERT(BOMBASTIC == l.getMsgLevel());
 
       l.pushState("2");
       l << "No" << endl;
-      assert(BOMBASTIC == l.getMsgLevel());
+      STATE_ASSERT(BOMBASTIC == l.getMsgLevel());
       l << decl << "No" << decl << "No" << endl;
-      assert(TRACE == l.getMsgLevel());
+      STATE_ASSERT(TRACE == l.getMsgLevel());
       l.popState();
     l << "No" << endl;
-    assert(TRACE == l.getMsgLevel());
+    STATE_ASSERT(TRACE == l.getMsgLevel());
 
       l.pushState("2",TERSE);
       l << "Yes" << endl;
-      assert(TERSE == l.getMsgLevel());
+      STATE_ASSERT(TERSE == l.getMsgLevel());
       l.popState();
     l << "No" << endl;
-    assert(TRACE == l.getMsgLevel());
+    STATE_ASSERT(TRACE == l.getMsgLevel());
 
     l.popState();
     l << "No" << endl;
-  assert(VERBOSE == l.getMsgLevel());
+  STATE_ASSERT(VERBOSE == l.getMsgLevel());
   return true;
 }
 
@@ -192,35 +226,37 @@ bool testBig() {
   log << 2 << " " << 3 << endl;
 
   log.setLevel(1);
+#ifndef NLOG
   if (1!=log.getLevel()) {FAILED_HERE; return false;}
+#endif
 
   log.dec();
-  assert(0==log.getLevel());
+  STATE_ASSERT(0==log.getLevel());
   log.dec();
-  assert(0==log.getLevel());
+  STATE_ASSERT(0==log.getLevel());
 
   log.setLevel(999);
-  assert(999==log.getLevel());
+  STATE_ASSERT(999==log.getLevel());
   log.dec();
-  assert(998==log.getLevel());
+  STATE_ASSERT(998==log.getLevel());
   log.inc();
-  assert(999==log.getLevel());
+  STATE_ASSERT(999==log.getLevel());
   
 
   log.setLevel(TRACE);
-  assert(log.entry(TRACE,"trace"));
-  assert(!log.entry(VERBOSE,"verbose")); // Not seen
+  STATE_ASSERT(log.entry(TRACE,"trace"));
+  STATE_ASSERT(!log.entry(VERBOSE,"verbose")); // Not seen
   log.inc();
-  assert(log.entry(VERBOSE,"verbose after log")); // Seen
+  STATE_ASSERT(log.entry(VERBOSE,"verbose after log") || VERBOSE>SLOGCXX_MAX_LEVEL); // Seen, unless compiled out
 
-  assert(log.partial(TRACE,"tracePartial"));
-  assert(log.complete());
+  STATE_ASSERT(log.partial(TRACE,"tracePartial"));
+  STATE_ASSERT(log.complete());
 
   log.dec();
-  assert(log.partial(TRACE,"a "));
-  assert(!log.partial(VERBOSE,"b "));
-  assert(log.partial(TRACE,"c "));
-  assert(log.complete());
+  STATE_ASSERT(log.partial(TRACE,"a "));
+  STATE_ASSERT(!log.partial(VERBOSE,"b "));
+  STATE_ASSERT(log.partial(TRACE,"c "));
+  STATE_ASSERT(log.complete());
 
 
   log.setLevel(VERBOSE);
@@ -241,25 +277,25 @@ bool testBig() {
   log << "Yes " << incl << "YES " << decl << "Yes!" << endl;
 
   {
-    assert(0==log.getStateDepth());
+    STATE_ASSERT(0==log.getStateDepth());
     LogState logstate1(&log,"one");
-    assert(1==log.getStateDepth());
+    STATE_ASSERT(1==log.getStateDepth());
     {
       LogState logstate2(&log,"two");
-      assert(2==log.getStateDepth());
+      STATE_ASSERT(2==log.getStateDepth());
       log.writeState();
       log << 2 << endl;
       // Try out an early explicit pop
       LogState logstate3(&log,"three");
-      assert(3==log.getStateDepth());
+      STATE_ASSERT(3==log.getStateDepth());
       log << 3 << endl;
       log.writeState();
       logstate3.pop(); // Here is the pop
-      assert(2==log.getStateDepth());
+      STATE_ASSERT(2==log.getStateDepth());
     }
-    assert(1==log.getStateDepth());
+    STATE_ASSERT(1==log.getStateDepth());
   }
-  assert(0==log.getStateDepth());
+  STATE_ASSERT(0==log.getStateDepth());
   return true;
 }
 
@@ -275,7 +311,7 @@ bool testTypes() {
   Slog l("types.log");
   l << "int: " << int(1) << endl;
   l << "size_t: " << size_t(9876541) << endl;
-  char *cstr="c style string";
+  char cstr[]="c style string";
   l << cstr << endl;
   l << std::string("C++ STL string") << endl;
   l << "char: " << 'c' << endl;
@@ -283,9 +319,76 @@ bool testTypes() {
   l << "long: " << long(3) << endl;
   l << "float: " << float(4.1) << endl;
   l << "double: " << double(5.2) << endl;
+  l << "long long: " << SlogLongLong(-1234567890)*1000-123 << endl;
+  l << "unsigned long long: " << ~SlogULongLong(0) << endl;
+  l << "unsigned char: " << static_cast<unsigned char>('u') << endl;
+  l << "bool: " << true << endl;
   return true;
 }
 
+/// Something of our own to log through a SlogTraits specialization
+struct TestCoord {
+  double x; ///< Easting
+  double y; ///< Northing
+};
+
+/// Tell operator<< how to log a TestCoord
+template <> struct SlogTraits<TestCoord> : SlogInsertable {
+  /// Write as (x,y)
+  static void format(SlogBuffer &buf, const TestCoord &c) {
+    buf.append('(');
+    buf.appendDouble(c.x);
+    buf.append(',');
+    buf.appendDouble(c.y);
+    buf.append(')');
+  }
+};
+
+/// A type with its own SlogTraits should format itself into the message
+bool testTraits() {
+  {
+    Slog l("test-traits.log"," ",false,false,false);
+    TestCoord c = {1.5,-2};
+    l << "coord " << c << " id " << 42u << endl;
+  }
+#ifndef NLOG
+  std::ifstream in("test-traits.log");
+  std::string line;
+  std::getline(in,line); // started logging
+  std::getline(in,line);
+  if (line!="coord (1.5,-2) id 42") {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+#ifndef NLOG
+/// Check the number formatters that the operator<< overloads use
+bool testNumberFormat() {
+  char buf[SLOG_NUMBER_BUFSIZE];
+  if (1!=slogFormatSigned(buf,0) || strcmp(buf,"0")) {FAILED_HERE; return false;}
+  slogFormatSigned(buf,-1);
+  if (strcmp(buf,"-1")) {FAILED_HERE; return false;}
+  slogFormatSigned(buf,LLONG_MIN);
+  if (strcmp(buf,"-9223372036854775808")) {FAILED_HERE; return false;}
+  slogFormatUnsigned(buf,ULLONG_MAX);
+  if (strcmp(buf,"18446744073709551615")) {FAILED_HERE; return false;}
+  slogFormatUnsigned(buf,100);
+  if (strcmp(buf,"100")) {FAILED_HERE; return false;}
+
+  // Shortest text that reads back the same
+  slogFormatDouble(buf,5.2);
+  if (strcmp(buf,"5.2")) {FAILED_HERE; return false;}
+  slogFormatDouble(buf,0.1);
+  if (strcmp(buf,"0.1")) {FAILED_HERE; return false;}
+  const double third = 1./3.;
+  slogFormatDouble(buf,third);
+  if (strtod(buf,0)!=third) {FAILED_HERE; return false;}
+  slogFormatFloat(buf,4.1f);
+  if (strcmp(buf,"4.1")) {FAILED_HERE; return false;}
+  return true;
+}
+#endif
+
 /// Simple test to see what happens
 class whereClassTest {
 public:
@@ -295,6 +398,18 @@ public:
 
 /// Try out the where and WHERE calls
 bool testWhere() {
+  // WHERE gets the leaf name of the file from the compiler
+  if (std::string(SLOG_FILE)!="slogcxx-test.cpp") {FAILED_HERE; return false;}
+#if !defined(NLOG) && __cplusplus >= 201103L
+  // Every pass through the same WHERE gets the same static Where
+  const Where *first = 0;
+  for (int i=0;i<2;i++) {
+    const Where &w = WHERE;
+    if (!first) first = &w;
+    else if (first != &w) {FAILED_HERE; return false;}
+  }
+  if (std::string(first->getFunction())!="testWhere") {FAILED_HERE; return false;}
+#endif
   {
     Slog l("test-where-noxml.log","\t",false,false);
     l.where("a file",123456,"some function");
@@ -320,6 +435,17 @@ bool testWhere() {
     whereClassTest wct;
     wct.doWhere(l);
   }
+#ifndef NLOG
+  {
+    // A Where that is not from WHERE gets copied, so it can be gone before the message is done
+    Slog l("",". ",false,false,false,true);
+    SlogMemorySink *mem = quietLog(l);
+    l << Where("temporary.cpp",42,"gone");
+    l << "later" << endl;
+    const std::vector<std::string> r = mem->getRecords();
+    if (1!=r.size() || std::string::npos==r[0].find("(temporary.cpp:42:gone)")) {FAILED_HERE; return false;}
+  }
+#endif
   return true;
 }
 
@@ -333,6 +459,793 @@ bool testPointer() {
     return true;
 }
 
+/// Helper for testEnabled that notices when it gets evaluated
+int countCall(int &calls) { return ++calls; }
+
+/// Disabled messages should not even evaluate their arguments when using SLOG
+bool testEnabled() {
+  Slog l("test-enabled.log");
+  l.setLevel(TRACE);
+#ifndef NLOG
+  if (!l.isEnabled(TRACE)) {FAILED_HERE; return false;}
+#else
+  if (l.isEnabled(TRACE)) {FAILED_HERE; return false;} // Nothing ever is
+#endif
+  if (l.isEnabled(VERBOSE)) {FAILED_HERE; return false;}
+  l.setMsgLevel(BOMBASTIC);
+  if (l.isEnabled()) {FAILED_HERE; return false;}
+
+  int calls=0;
+  SLOG(l,BOMBASTIC) << "Should NOT see this " << countCall(calls) << endl;
+  if (0!=calls) {FAILED_HERE; return false;}
+  SLOG(l,TERSE) << "Should see this " << countCall(calls) << endl;
+#ifndef NLOG
+  if (1!=calls) {FAILED_HERE; return false;}
+  if (TERSE!=l.getMsgLevel()) {FAILED_HERE; return false;}
+#else
+  if (0!=calls) {FAILED_HERE; return false;} // Compiled out, arguments and all
+#endif
+
+  // Make sure the macro does not steal an else
+  if (0<=calls) SLOG(l,TERSE) << "Should see this too" << endl;
+  else {FAILED_HERE; return false;}
+  return true;
+}
+
+/// Count the lines in a log file
+int countLines(const char *filename) {
+  std::ifstream in(filename);
+  std::string line;
+  int lines=0;
+  while (std::getline(in,line)) lines++;
+  return lines;
+}
+
+/// Push a pile of entries through the writer thread and then go back to synchronous
+bool testAsync() {
+  {
+    Slog l("test-async.log"," ",false,false,false);
+    l.enableAsync(8);
+    for (int i=0;i<200;i++) l << "async entry " << i << endl;
+    l.flush();
+    if (0!=l.getDroppedCount()) {FAILED_HERE; return false;}
+    l.disableAsync();
+    if (l.getAsyncStatus()) {FAILED_HERE; return false;}
+    l << "back to synchronous" << endl;
+  }
+#ifndef NLOG
+  // started + 200 + back to synchronous + stopped
+  if (203!=countLines("test-async.log")) {FAILED_HERE; return false;}
+#endif
+
+  unsigned long dropped;
+  {
+    Slog l("test-async-drop.log"," ",false,false,false);
+    l.enableAsync(1,OVERFLOW_DROP_OLDEST);
+    for (int i=0;i<500;i++) l.entry(ALWAYS,"maybe dropped");
+    l.disableAsync();
+    dropped = l.getDroppedCount();
+  }
+#ifndef NLOG
+  // Everything that was not dropped has to be in the file
+  if (int(502-dropped)!=countLines("test-async-drop.log")) {FAILED_HERE; return false;}
+#else
+  if (0!=dropped) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+#ifndef NLOG
+/// The indent, depth label and scope name follow pushes, pops and indent changes
+bool testScopeCache() {
+  Slog l("",". ",false,false,false);
+  if (""!=l.indent() || " 0"!=l.getStateNumberStr() || ""!=l.getCurScope()) {FAILED_HERE; return false;}
+  for (int i=0;i<12;i++) l.pushState(i%2?"odd":"even");
+  if (". . . . . . . . . . . . "!=l.indent()) {FAILED_HERE; return false;}
+  if ("12"!=l.getStateNumberStr() || "odd"!=l.getCurScope()) {FAILED_HERE; return false;}
+  l.setStateIndent("\t");
+  if (std::string(12,'\t')!=l.indent()) {FAILED_HERE; return false;}
+  for (int i=0;i<3;i++) l.popState();
+  if (std::string(9,'\t')!=l.indent()) {FAILED_HERE; return false;}
+  if (" 9"!=l.getStateNumberStr() || "even"!=l.getCurScope()) {FAILED_HERE; return false;}
+  while (0<l.getStateDepth()) l.popState();
+  if (""!=l.indent() || " 0"!=l.getStateNumberStr() || ""!=l.getCurScope()) {FAILED_HERE; return false;}
+  return true;
+}
+#endif
+
+/// Each sink gets the entries at or below its own level, in its own format
+bool testSinks() {
+  Slog l("",". ",false,true,false,false);
+  l.setLevel(BOMBASTIC);
+  UNUSED SlogMemorySink *text = quietLog(l);
+  SlogMemorySink *xml = new SlogMemorySink(FORMAT_XML,TERSE);
+  SlogMemorySink *recent = new SlogMemorySink(FORMAT_CONSOLE,NEVER,2);
+  l.addSink(xml);
+  l.addSink(recent);
+  l.entry(LACONIC,"important");
+  l.pushState("scope");
+  l.entry(TRACE,"chatty"); // Still in with SLOGCXX_MAX_LEVEL at TRACE
+  l.popState();
+  l.entry(TRACE,"very chatty");
+  l.flush();
+#ifndef NLOG
+  const std::vector<std::string> t = text->getRecords();
+  if (3!=t.size() || "important\n"!=t[0] || ". scope: chatty\n"!=t[1]) {FAILED_HERE; return false;}
+  // XML gets its scope tags even though the entry inside was too chatty for it
+  const std::vector<std::string> x = xml->getRecords();
+  if (3!=x.size() || "<entry>important</entry>\n"!=x[0] || "<scope name=\"scope\">\n"!=x[1]) {FAILED_HERE; return false;}
+  const std::vector<std::string> r = recent->getRecords();
+  if (2!=r.size() || " 0: very chatty\n"!=r[1]) {FAILED_HERE; return false;}
+  if (l.removeSink(0)) {FAILED_HERE; return false;}
+  if (!l.removeSink(text)) {FAILED_HERE; return false;}
+  if (!l.removeSink(l.getConsoleSink()) || 0!=l.getConsoleSink()) {FAILED_HERE; return false;}
+  l.entry(LACONIC,"no console");
+  if (4!=xml->size()) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// A binary sink decodes to exactly what a text sink wrote for the same entries
+bool testBinary() {
+  Slog l("",". ",false,true,true,true);
+  l.setLevel(BOMBASTIC);
+  UNUSED SlogMemorySink *text = quietLog(l);
+  SlogMemorySink *xml = new SlogMemorySink(FORMAT_XML);
+  l.addSink(xml);
+  l.pushState("before");  // Open before the binary sink shows up
+  SlogMemorySink *bin = new SlogMemorySink(FORMAT_BINARY);
+  l.addSink(bin);
+  l << WHERE << "ints " << -42 << " " << 7u << " " << SlogLongLong(-9)*1000000000 << endl;
+  l.pushState("inner");
+  l << "floats " << 5.2 << " " << 0.1f << " char " << 'x' << " bool " << true << endl;
+  for (int i=0;i<3;i++) l << WHERE << "again " << i << endl;
+  l.writeState();
+  l.popState();
+  l.entry(TERSE,"plain entry");
+  l.popState();
+  l.flush();
+#ifndef NLOG
+  std::string binary;
+  const std::vector<std::string> b = bin->getRecords();
+  for (size_t i=0;i<b.size();i++) binary += b[i];
+  std::string expected;
+  const std::vector<std::string> t = text->getRecords();
+  for (size_t i=0;i<t.size();i++) expected += t[i];
+  // Feed it in small pieces so that records get split
+  SlogDecoder decoder(FORMAT_TEXT,TIME_EPOCH_MICROS,". ");
+  std::string decoded;
+  for (size_t i=0;i<binary.size();i+=7)
+    if (!decoder.decode(binary.data()+i,std::min<size_t>(7,binary.size()-i),decoded)) {FAILED_HERE; return false;}
+  decoder.finish(decoded);
+  if (expected!=decoded) {FAILED_HERE; std::cerr << expected << "----\n" << decoded; return false;}
+
+  std::string xmlExpected;
+  const std::vector<std::string> x = xml->getRecords();
+  for (size_t i=0;i<x.size();i++) xmlExpected += x[i]; // Including the scope opened before the binary sink came
+  std::string xmlDecoded;
+  SlogDecoder xmlDecoder(FORMAT_XML,TIME_EPOCH_MICROS,". ");
+  if (!xmlDecoder.decode(binary.data(),binary.size(),xmlDecoded)) {FAILED_HERE; return false;}
+  if (xmlExpected!=xmlDecoded) {FAILED_HERE; std::cerr << xmlExpected << "----\n" << xmlDecoded; return false;}
+
+  // Garbage is caught rather than decoded
+  SlogDecoder bad;
+  std::string junk("Xjunk that is not a binary log at all");
+  junk[1]=junk[2]=junk[3]=junk[4]='\x7f';
+  if (bad.decode(junk.data(),junk.size(),decoded)) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Records are in a memory mapped file as soon as they are written, and the file is trimmed when closed
+bool testMmapSink() {
+  {
+    Slog l("",". ",false,true,false,false);
+    l.getConsoleSink()->setLevel(ALWAYS); // Keep the console quiet
+    SlogMmapSink *mm = new SlogMmapSink("test-mmap.log",false,FORMAT_TEXT,NEVER,4096);
+    l.addSink(mm);
+#ifndef NLOG
+    if (!mm->isOpen()) {FAILED_HERE; return false;}
+#endif
+    for (int i=0;i<1000;i++) l << "entry number " << i << endl; // Several chunks
+    l.pushState("scope");
+    l.entry(ALWAYS,"last words");
+#ifndef NLOG
+    // Still open, so the file is whole chunks with nuls on the end, but the records are there
+    std::ifstream in("test-mmap.log");
+    std::string contents((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    if (0!=contents.size()%4096 || contents.size()<mm->size()) {FAILED_HERE; return false;}
+    if (std::string::npos==contents.find(". scope: last words\n")) {FAILED_HERE; return false;}
+#endif
+    l.popState();
+  }
+  {
+    Slog l("",". ",false,true,false,false);
+    l.getConsoleSink()->setLevel(ALWAYS);
+    l.addSink(new SlogMmapSink("test-mmap.log",true,FORMAT_TEXT,NEVER,4096));
+    l.entry(ALWAYS,"appended");
+  }
+#ifndef NLOG
+  // started logging comes before the sink is added, so 1000, last words, stopped logging, then 2 more
+  if (1004!=countLines("test-mmap.log")) {FAILED_HERE; return false;}
+  std::ifstream in("test-mmap.log");
+  std::string contents((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+  if (std::string::npos!=contents.find('\0')) {FAILED_HERE; return false;}
+  if (contents.compare(contents.size()-25,25,"appended\nstopped logging\n")) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// The log file moves along to numbered files as it fills, keeping only as many as asked for
+bool testRotation() {
+  const char *names[] = {"test-rotate.log","test-rotate.log.1","test-rotate.log.2","test-rotate.log.3","test-rotate.log.next",
+                         "test-rotate.log.next.1"};
+  for (int i=0;i<6;i++) std::remove(names[i]);
+  {
+    std::ofstream crashed(names[4]);
+    crashed << "left by a crash\n"; // A spare must never reuse it
+  }
+  UNUSED unsigned rotations=0;
+  {
+    Slog l("test-rotate.log"," ",false,false,false);
+    l.setRotation(1000,0,2);
+    for (int i=0;i<200;i++) {
+      l << "rotation test entry " << i << endl; // 24 to 26 bytes
+      l.flush();
+#ifdef CONCURRENT_BOOST
+      // A rotation is skipped while the last one is still being finished, so give that thread a chance
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+#endif
+    }
+#ifndef NLOG
+    rotations = static_cast<SlogFileSink*>(l.getFileSink())->getRotations();
+#endif
+  }
+#ifndef NLOG
+  if (rotations<1) {FAILED_HERE; return false;}
+  for (int i=0;i<3;i++) {
+    std::ifstream in(names[i]);
+    if (!in.is_open()) {FAILED_HERE; return false;}
+    in.seekg(0,std::ios::end);
+    if (1000+30<in.tellg()) {FAILED_HERE; return false;} // Never more than one entry past the limit
+  }
+  if (std::ifstream(names[3]).is_open() || std::ifstream(names[5]).is_open()) {FAILED_HERE; return false;}
+  std::ifstream crashed(names[4]);
+  std::string line, last;
+  if (!std::getline(crashed,line) || "left by a crash"!=line) {FAILED_HERE; return false;}
+  // The newest entries are in the current file
+  std::ifstream in(names[0]);
+  while (std::getline(in,line)) if (line.size()) last=line;
+  if ("stopped logging"!=last) {FAILED_HERE; return false;}
+#endif
+  std::remove(names[4]);
+  return true;
+}
+
+#ifdef SLOGCXX_ZLIB
+/// Compressed output reads back the same as plain, whether the sink has finished or not
+bool testGzipSink() {
+  std::string text;
+  {
+    Slog l("",". ",false,true,false,false);
+    SlogMemorySink *plain = quietLog(l, FORMAT_XML);
+    SlogGzipSink *gz = new SlogGzipSink("test-gzip.log.gz",false,FORMAT_XML);
+    l.addSink(gz);
+    l.setFlushPolicy(4096,0,ALWAYS); // Several blocks
+    LogState s(&l,"compressed");
+    for (int i=0;i<2000;i++) l << "entry " << i << " of a very repetitive log" << endl;
+    l.flush();
+#ifndef NLOG
+    // Everything handed over so far can be read before the file is finished
+    gzFile in = gzopen("test-gzip.log.gz","rb");
+    char buf[4096];
+    std::string partial;
+    for (int got; 0<(got=gzread(in,buf,sizeof(buf)));) partial.append(buf,got);
+    gzclose(in);
+    if (std::string::npos==partial.find("entry 1999 of a very repetitive log")) {FAILED_HERE; return false;}
+#endif
+    s.pop();
+    const std::vector<std::string> records = plain->getRecords();
+    for (size_t i=0;i<records.size();i++) text += records[i];
+  }
+#ifndef NLOG
+  gzFile in = gzopen("test-gzip.log.gz","rb");
+  char buf[4096];
+  std::string unzipped;
+  for (int got; 0<(got=gzread(in,buf,sizeof(buf)));) unzipped.append(buf,got);
+  gzclose(in);
+  // The memory sink missed stopped logging, which came after it was copied
+  if ("<slogcxx>\n"+text+"<entry>stopped logging</entry>\n</slogcxx>\n"!=unzipped) {FAILED_HERE; return false;}
+  std::ifstream gz("test-gzip.log.gz");
+  gz.seekg(0,std::ios::end);
+  if (gz.tellg()*10>std::streamoff(unzipped.size())) {FAILED_HERE; return false;} // Should shrink a lot
+#endif
+  return true;
+}
+#endif
+
+/// SLOG_SAMPLE and SLOG_RATE hold records back before formatting them, and say how many they held back
+bool testRateLimit() {
+  Slog l("",". ",false,true,false,false);
+  SlogMemorySink *mem = quietLog(l);
+  int calls=0;
+  for (int i=0;i<1000;i++) SLOG_SAMPLE(l,TERSE,100) << "sampled " << i << countCall(calls) << endl;
+#if !defined(NLOG) && __cplusplus >= 201103L
+  if (10!=calls || 10!=mem->size()) {FAILED_HERE; return false;}
+  const std::vector<std::string> r = mem->getRecords();
+  if ("sampled 01\n"!=r[0] || "[99 suppressed] sampled 1002\n"!=r[1]) {FAILED_HERE; return false;}
+#endif
+  mem->clear();
+  calls=0;
+  for (int i=0;i<1000;i++) SLOG_RATE(l,TERSE,5) << "limited " << i << countCall(calls) << endl;
+#if !defined(NLOG) && __cplusplus >= 201103L
+  // 5 a second, but the loop could run across the start of a new second
+  if (calls<5 || 10<calls || mem->size()!=size_t(calls)) {FAILED_HERE; return false;}
+#endif
+  SLOG_RATE(l,BOMBASTIC,5) << "not enabled, so not counted" << endl;
+  return true;
+}
+
+/// Levels over SLOGCXX_MAX_LEVEL are gone for good, while the rest still follow setLevel()
+bool testLevelFloor() {
+  Slog l("",". ",false,true,false,false);
+  SlogMemorySink *mem = quietLog(l);
+  l.setLevel(BOMBASTIC);
+  int calls=0;
+  l << SDEBUG << "debug" << endl;
+  l << SINFO << "info" << endl;
+  l << SWARNING << "warning" << endl;
+  SLOG(l,VERBOSE) << "verbose " << countCall(calls) << endl;
+  l.entry(BOMBASTIC,"bombastic");
+#ifndef NLOG
+  const bool verbose = VERBOSE<=SLOGCXX_MAX_LEVEL;
+  const bool bombastic = BOMBASTIC<=SLOGCXX_MAX_LEVEL;
+  if (l.isEnabled(BOMBASTIC)!=bombastic) {FAILED_HERE; return false;}
+  if (calls!=int(verbose)) {FAILED_HERE; return false;}
+  const std::vector<std::string> r = mem->getRecords();
+  if (r.size()!=1+2*size_t(verbose)+2*size_t(bombastic)) {FAILED_HERE; return false;}
+  if (bombastic && "debug: debug\n"!=r[0]) {FAILED_HERE; return false;}
+  if (!verbose && "warning: warning\n"!=r[0]) {FAILED_HERE; return false;}
+#endif
+
+  // Levels that are compiled in are still up to setLevel()
+  mem->clear();
+  l.setLevel(LACONIC);
+  l << SWARNING << "not at LACONIC" << endl;
+  l << SERROR << "at LACONIC" << endl;
+#ifndef NLOG
+  if (1!=mem->size() || "error: at LACONIC\n"!=mem->getRecords()[0]) {FAILED_HERE; return false;}
+#endif
+
+  // A level that is compiled out still sets the message level, which sticks
+  mem->clear();
+  l.setLevel(TRACE);
+  l << SDEBUG << "debug" << endl;
+  l << "after debug" << endl;
+#ifndef NLOG
+  if (0!=mem->size()) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Named loggers follow the level above them until given one, and write through the Slog they came from
+bool testLoggers() {
+  Slog l("",". ",false,true,false,false);
+  UNUSED SlogMemorySink *mem = quietLog(l);
+  l.setLevel(TERSE);
+  Slog &rpc = l.getLogger("net.rpc");
+  Slog &net = l.getLogger("net");
+  Slog &pool = rpc.getLogger("db.pool"); // Same as asking l
+#ifndef NLOG
+  if (&rpc!=&l.getLogger("net.rpc") || "net.rpc"!=rpc.getName() || "db.pool"!=pool.getName()) {FAILED_HERE; return false;}
+  if (TERSE!=rpc.getLevel() || TERSE!=pool.getLevel()) {FAILED_HERE; return false;}
+#endif
+
+  net.setLevel(TRACE);
+  SLOG(rpc,TRACE) << "rpc at trace" << endl;
+  SLOG(pool,TRACE) << "pool at trace" << endl;
+  l.entry(TRACE,"top at trace");
+  {
+    LogState scope(&rpc,"call",TRACE);
+    rpc << "in a call" << endl;
+  }
+  rpc << TERSE << "out of the call" << endl;
+#ifndef NLOG
+  if (TRACE!=rpc.getLevel() || TERSE!=pool.getLevel() || TERSE!=l.getLevel()) {FAILED_HERE; return false;}
+  const std::vector<std::string> r = mem->getRecords();
+  if (3!=r.size() || "rpc at trace\n"!=r[0] || ". call: in a call\n"!=r[1] || "out of the call\n"!=r[2]) {FAILED_HERE; return false;}
+  if (TERSE!=l.getMsgLevel()) {FAILED_HERE; return false;} // The message level is the logger's own
+#endif
+
+  // Once set, a level stays put until told to follow again
+  rpc.setLevel(LACONIC);
+  net.inc();
+  l.setLevel(BOMBASTIC);
+  rpc.dec();
+#ifndef NLOG
+  if (LACONIC!=rpc.getLevel() || VERBOSE!=net.getLevel() || BOMBASTIC!=pool.getLevel()) {FAILED_HERE; return false;}
+#endif
+  rpc.inheritLevel();
+  net.inheritLevel();
+  l.inheritLevel();
+#ifndef NLOG
+  if (BOMBASTIC!=rpc.getLevel() || BOMBASTIC!=net.getLevel() || BOMBASTIC!=l.getLevel()) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Runs of the same entry come out once, followed by how many times it was repeated
+bool testCollapse() {
+  Slog l("",". ",false,true,false,false);
+  UNUSED SlogMemorySink *mem = quietLog(l);
+  l.enableCollapse();
+  for (int i=0;i<100;i++) l << "retrying " << 3 << endl;
+  l << "retrying " << 4 << endl;
+  l << "retrying " << 4 << endl;
+  l.pushState("scope");
+  l << "retrying " << 4 << endl; // In a different scope, so not a repeat
+  l << "retrying " << 4 << endl;
+  l.flush();
+  l.entry(TERSE,"done");
+  l.popState();
+  l.disableCollapse();
+  l.entry(TERSE,"done");
+  l.entry(TERSE,"done");
+#ifndef NLOG
+  const std::vector<std::string> r = mem->getRecords();
+  if (9!=r.size() || "retrying 3\n"!=r[0] || "retrying 4\n"!=r[2] || ". scope: retrying 4\n"!=r[4]) {FAILED_HERE; return false;}
+  if (0!=r[1].find("last message repeated 99 times (first ") || 0!=r[3].find("last message repeated 1 time (")) {FAILED_HERE; return false;}
+  if (0!=r[5].find(". scope: last message repeated 1 time")) {FAILED_HERE; return false;} // Brought out by flush()
+  if (". scope: done\n"!=r[6] || "done\n"!=r[7] || "done\n"!=r[8]) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Replace the test config file with text
+static void writeConfig(const char *text) {
+  std::ofstream out("test-config.conf");
+  out << text;
+}
+
+/// A config file changes the settings of a running Slog, and a bad one changes nothing
+bool testConfig() {
+  Slog l("",". ",false,true,false,false);
+  UNUSED SlogMemorySink *mem = quietLog(l);
+  Slog &rpc = l.getLogger("net.rpc");
+  Slog &db = l.getLogger("db");
+  db.setLevel(LACONIC);
+  writeConfig("# Turn it up\nlevel = TRACE\n\n  level.net.rpc = 4\nlevel.db=inherit\nlocation = on\nxml = off\nfile = test-config.log\n");
+  l.watchConfig("test-config.conf",0); // Nobody looks but pollConfig()
+#ifndef NLOG
+  if (TRACE!=l.getLevel() || BOMBASTIC!=rpc.getLevel() || TRACE!=db.getLevel()) {FAILED_HERE; return false;}
+  if (!l.getLocationStatus() || l.getXmlStatus() || l.getTimeStatus() || !l.getFileSink()) {FAILED_HERE; return false;}
+  if ("loaded config file test-config.conf\n"!=mem->getRecords().back()) {FAILED_HERE; return false;}
+#endif
+  if (l.pollConfig()) {FAILED_HERE; return false;} // Nothing new
+
+  // One bad line and none of it is used
+  writeConfig("level = VERBOSE\nfile =\nlevel.net = loud\n");
+  UNUSED const bool reloaded = rpc.pollConfig(); // A different size
+#ifndef NLOG
+  if (!reloaded) {FAILED_HERE; return false;}
+  if (TRACE!=l.getLevel() || !l.getFileSink()) {FAILED_HERE; return false;}
+  if ("test-config.conf:3: bad setting, nothing changed: level.net = loud\n"!=mem->getRecords().back()) {FAILED_HERE; return false;}
+#endif
+  if (l.pollConfig()) {FAILED_HERE; return false;}
+
+  l.enableCollapse();
+  for (int i=0; i<3; i++) l.entry(ALWAYS, "again");
+  writeConfig("level = VERBOSE\nfile =\nlevel.net = BOMBASTIC\nlevel.net.rpc = inherit\ncollapse = off\n");
+#ifndef NLOG
+  raise(SIGHUP); // Only counted, so the file is read again even if it looked the same
+#endif
+  UNUSED const bool hungUp = l.pollConfig();
+  if (l.pollConfig()) {FAILED_HERE; return false;}
+#ifndef NLOG
+  if (!hungUp) {FAILED_HERE; return false;}
+  if (VERBOSE!=l.getLevel() || BOMBASTIC!=rpc.getLevel() || VERBOSE!=db.getLevel() || l.getFileSink()) {FAILED_HERE; return false;}
+  const std::vector<std::string> &r = mem->getRecords();
+  if (l.getCollapseStatus() || 0!=r[r.size()-2].find("last message repeated 2 times")) {FAILED_HERE; return false;}
+#endif
+
+#ifdef CONCURRENT_BOOST
+  l.watchConfig("test-config.conf",0.01);
+  writeConfig("level = LACONIC\n");
+#ifndef NLOG
+  for (int i=0; i<500 && LACONIC!=l.getLevel(); i++) usleep(10000);
+  if (LACONIC!=l.getLevel() || LACONIC!=db.getLevel()) {FAILED_HERE; return false;}
+#endif
+#endif
+  l.unwatchConfig();
+  writeConfig("level = TERSE\n");
+  if (l.pollConfig()) {FAILED_HERE; return false;}
+  return true;
+}
+
+/// A fatal signal still gets the buffered entries, the signal and the closing tags into the file
+bool testCrashHandler() {
+  std::cout.flush(); // Or the child prints it again
+  const pid_t pid = fork();
+  if (0>pid) {FAILED_HERE; return false;}
+  if (0==pid) {
+    const struct rlimit noCore = {0,0};
+    setrlimit(RLIMIT_CORE,&noCore);
+    Slog l("test-crash.log"," ",false,true,false,false);
+    l.getConsoleSink()->setLevel(ALWAYS); // Keep the console quiet
+    l.setFlushPolicy(1<<20,0,LACONIC); // Nothing reaches the file by itself
+    l.enableCrashHandler();
+    l.pushState("doomed");
+    for (int i=0;i<10;i++) l.entry(TERSE,"buffered");
+    abort();
+  }
+  int status;
+  if (pid!=waitpid(pid,&status,0)) {FAILED_HERE; return false;}
+  if (!WIFSIGNALED(status) || SIGABRT!=WTERMSIG(status)) {FAILED_HERE; return false;} // Passed on to the default handler
+#ifndef NLOG
+  std::ifstream in("test-crash.log");
+  const std::string contents((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+  std::size_t count = 0;
+  for (std::size_t pos=0; std::string::npos!=(pos=contents.find(">buffered</entry>",pos)); pos++) count++;
+  if (10!=count) {FAILED_HERE; return false;}
+  const std::string tail = " <entry scope=\"doomed\">fatal signal 6 (SIGABRT)</entry>\n</scope> <!-- doomed -->\n</slogcxx>\n";
+  if (contents.size()<tail.size() || contents.compare(contents.size()-tail.size(),tail.size(),tail)) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Log file output waits in the buffer until the flush policy says it is time
+bool testFlushPolicy() {
+  Slog l("test-flush.log"," ",false,false,false);
+  l.setFlushPolicy(1<<20,0,LACONIC); // Big buffer, no time limit
+  for (int i=0;i<10;i++) l.entry(TERSE,"buffered");
+#ifndef NLOG
+  if (1!=countLines("test-flush.log")) {FAILED_HERE; return false;} // Only "started logging"
+  l.entry(LACONIC,"important");
+  if (12!=countLines("test-flush.log")) {FAILED_HERE; return false;} // Pulls the rest out with it
+  l.entry(TERSE,"buffered again");
+  if (12!=countLines("test-flush.log")) {FAILED_HERE; return false;}
+  l.flush();
+  if (13!=countLines("test-flush.log")) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Time stamps have their microseconds in both formats and the monotonic clock never goes backwards
+bool testTimeFormat() {
+  {
+    Slog l("test-time.log"," ",false,false,true);
+    l.setTimeFormat(TIME_ISO8601);
+#ifndef NLOG
+    if (TIME_ISO8601!=l.getTimeFormat()) {FAILED_HERE; return false;}
+#endif
+    l.entry(ALWAYS,"iso");
+    l.setTimeFormat(TIME_EPOCH_MICROS,CLOCK_SOURCE_MONOTONIC);
+#ifndef NLOG
+    if (CLOCK_SOURCE_MONOTONIC!=l.getClockSource()) {FAILED_HERE; return false;}
+#endif
+    for (int i=0;i<100;i++) l.entry(ALWAYS,"mono");
+  }
+#ifndef NLOG
+  std::ifstream in("test-time.log");
+  std::string line;
+  std::getline(in,line); // started logging
+  std::getline(in,line);
+  // 2007-10-02T20:17:19.123456Z iso
+  if (line.size()<28 || '-'!=line[4] || 'T'!=line[10] || '.'!=line[19] || 'Z'!=line[26]) {FAILED_HERE; return false;}
+  double last=0;
+  for (int i=0;i<100;i++) {
+    std::getline(in,line);
+    const size_t dot=line.find('.');
+    if (std::string::npos==dot || ' '!=line[dot+7]) {FAILED_HERE; return false;}
+    const double t=atof(line.c_str());
+    if (t<last) {FAILED_HERE; return false;}
+    last=t;
+  }
+#endif
+  return true;
+}
+
+#ifdef CONCURRENT_BOOST
+/// Body for testThreads: build each message a piece at a time
+void threadWorker(Slog *l, int id) {
+  for (int i=0;i<100;i++) *l << "thread " << id << " part a " << "part b " << i << endl;
+}
+
+/// Several threads building messages at once must not mix up each others pieces
+bool testThreads() {
+  {
+    Slog l("test-threads.log"," ",false,false,false);
+    boost::thread t1(threadWorker,&l,1), t2(threadWorker,&l,2), t3(threadWorker,&l,3);
+    t1.join(); t2.join(); t3.join();
+  }
+#ifndef NLOG
+  std::ifstream in("test-threads.log");
+  std::string line;
+  int lines=0;
+  while (std::getline(in,line)) {
+    lines++;
+    if (line.find("thread ")==std::string::npos) continue; // started/stopped
+    if (line.find("thread ")!=line.rfind("thread ")) {FAILED_HERE; return false;}
+    if (line.find(" part a part b ")==std::string::npos) {FAILED_HERE; return false;}
+  }
+  if (302!=lines) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Body for testAsyncThreads: every other record is too long to fit in a ring slot
+void asyncWorker(Slog *l, int id) {
+  const std::string padding(300,'x');
+  for (int i=0;i<500;i++) {
+    if (i%2) *l << "long " << id << " " << padding << endl;
+    else *l << "short " << id << endl;
+  }
+}
+
+/// Several threads queueing at once through a ring that is much too small
+bool testAsyncThreads() {
+  Slog l("",". ",false,false,false);
+  SlogMemorySink *mem = quietLog(l, FORMAT_TEXT,TERSE);
+  l.enableAsync(16);
+  boost::thread t1(asyncWorker,&l,1), t2(asyncWorker,&l,2), t3(asyncWorker,&l,3), t4(asyncWorker,&l,4);
+  t1.join(); t2.join(); t3.join(); t4.join();
+  l.flush();
+#ifndef NLOG
+  const std::vector<std::string> records = mem->getRecords();
+  if (2000!=records.size()) {FAILED_HERE; return false;}
+  for (size_t i=0;i<records.size();i++) {
+    const std::string &r = records[i];
+    if (0==r.find("long ") && (r.size()!=308 || r.find(std::string(300,'x'))!=7)) {FAILED_HERE; return false;}
+    if (0==r.find("short ") && r.size()!=8) {FAILED_HERE; return false;}
+  }
+#endif
+  if (0!=l.getDroppedCount()) {FAILED_HERE; return false;}
+  return true;
+}
+
+/// Body for testScopeOrder: log until told to stop
+void orderWorker(Slog *l, boost::atomic<bool> *stop) {
+  while (!stop->load()) *l << TERSE << "working" << endl;
+}
+
+/// Entries from other threads come out inside the scope they were logged in, never after it has closed
+bool testScopeOrder() {
+  for (int async=0; async<2; async++) {
+    Slog l(""," ",false,true,false,false);
+    SlogMemorySink *mem = quietLog(l, FORMAT_XML);
+    if (async) l.enableAsync(64);
+    boost::atomic<bool> stop(false);
+    boost::thread t1(orderWorker,&l,&stop), t2(orderWorker,&l,&stop), t3(orderWorker,&l,&stop);
+    for (int i=0;i<300;i++) {
+      l.pushState("outer");
+      if (i%2) l.pushState("inner");
+      boost::this_thread::yield();
+      if (i%2) l.popState();
+      l.popState();
+    }
+    stop.store(true);
+    t1.join(); t2.join(); t3.join();
+    l.flush();
+#ifndef NLOG
+    std::vector<std::string> open;
+    const std::vector<std::string> r = mem->getRecords();
+    for (size_t i=0;i<r.size();i++) {
+      const std::string::size_type tag = r[i].find_first_not_of(' ');
+      if (0==r[i].compare(tag,13,"<scope name=\"")) open.push_back(r[i].substr(tag+13,r[i].find('"',tag+13)-tag-13));
+      else if (0==r[i].compare(tag,8,"</scope>")) open.pop_back();
+      else if (open.empty() ? std::string::npos!=r[i].find(" scope=")
+               : std::string::npos==r[i].find(" scope=\""+open.back()+"\"")) {FAILED_HERE; return false;}
+    }
+#endif
+  }
+  return true;
+}
+
+/// Holds the writer thread up in write() on an entry saying hold, until let go
+class HoldingSink : public SlogSink {
+public:
+  HoldingSink() : SlogSink(FORMAT_TEXT), holding(false), release(false) {}
+  void write(UNUSED const int lvl, const std::string &text) {
+    if (std::string::npos==text.find("hold")) return;
+    holding.store(true);
+    while (!release.load()) boost::this_thread::yield();
+  }
+  boost::atomic<bool> holding;	///< The writer is stuck in here
+  boost::atomic<bool> release;	///< Let it go
+};
+
+/// Body for testSinkChangeThreads
+void countWorker(Slog *l) {
+  for (int i=0;i<3000;i++) *l << TERSE << "working " << i << endl;
+}
+
+/// Sinks and the file format change while threads queue entries, and not one entry goes missing
+bool testSinkChangeThreads() {
+  {
+    // The switch to XML waits in the queue behind the stuck entry, and neither holds up the entry after
+    Slog l("test-sink-change.log"," ",false,false,false,false);
+    l.getConsoleSink()->setLevel(ALWAYS);
+    HoldingSink *hold = new HoldingSink;
+    l.addSink(hold);
+    l.enableAsync(64);
+    l.entry(ALWAYS,"hold");
+    while (!hold->holding.load()) boost::this_thread::yield();
+    l.enableXml();
+    l.entry(ALWAYS,"queued after the switch");
+    hold->release.store(true);
+  }
+#ifndef NLOG
+  {
+    std::ifstream in("test-sink-change.log");
+    const std::string contents((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    if (std::string::npos==contents.find("<entry>queued after the switch</entry>")) {FAILED_HERE; return false;}
+  }
+#endif
+  {
+    Slog l("test-sink-change.log"," ",false,false,false,false);
+    SlogMemorySink *mem = quietLog(l, FORMAT_TEXT, TERSE);
+    l.enableAsync(64);
+    boost::thread t1(countWorker,&l), t2(countWorker,&l), t3(countWorker,&l);
+    for (int i=0;i<100;i++) {
+      if (i%2) l.enableXml(); else l.disableXml();
+      SlogMemorySink *extra = new SlogMemorySink(FORMAT_XML);
+      l.addSink(extra);
+      boost::this_thread::yield();
+      if (!l.removeSink(extra)) {FAILED_HERE; return false;}
+    }
+    t1.join(); t2.join(); t3.join();
+    l.flush();
+#ifndef NLOG
+    const std::vector<std::string> records = mem->getRecords();
+    if (9000!=records.size()) {FAILED_HERE; return false;}
+#endif
+  }
+#ifndef NLOG
+  // Whichever format each entry came out in, it came out
+  std::ifstream in("test-sink-change.log");
+  std::string line;
+  int entries=0;
+  while (std::getline(in,line)) if (std::string::npos!=line.find("working ")) entries++;
+  if (9000!=entries) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+
+/// Body for testLevelThreads: log at every level, through a named logger and the top Slog
+void levelWorker(Slog *l, Slog *named, boost::atomic<bool> *stop) {
+  while (!stop->load()) {
+    for (int lvl=LACONIC;lvl<=BOMBASTIC;lvl++) {
+      SLOG(*named,lvl) << "named " << lvl << endl;
+      *l << LogLevelsEnum(lvl) << WHERE << "top " << lvl << endl;
+    }
+  }
+}
+
+/// Levels and settings change while other threads are logging, with no locks on the logging side
+bool testLevelThreads() {
+  Slog l("",". ",false,false,true);
+  quietLog(l, FORMAT_TEXT, NEVER, 100);
+  Slog &named = l.getLogger("worker");
+  boost::atomic<bool> stop(false);
+  boost::thread t1(levelWorker,&l,&named,&stop), t2(levelWorker,&l,&named,&stop);
+  for (int i=0;i<200;i++) {
+    l.setLevel(i%BOMBASTIC); // Ends up at VERBOSE
+    if (i%3) named.inc(); else named.inheritLevel();
+    if (i%2) l.enableTime(); else l.disableTime();
+    if (i%5) l.enableLocation(); else l.disableLocation();
+    if (i%7) l.enableCollapse(); else l.disableCollapse();
+    boost::this_thread::yield();
+  }
+  stop.store(true);
+  t1.join(); t2.join();
+  named.inheritLevel();
+#ifndef NLOG
+  if (VERBOSE!=l.getLevel() || VERBOSE!=named.getLevel()) {FAILED_HERE; return false;}
+#endif
+  return true;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // main
 //////////////////////////////////////////////////////////////////////
@@ -348,7 +1261,11 @@ int main(UNUSED int argc, UNUSED char *argv[]) {
   // This will not be pretty since the loggers send stuff to cout
   if (!testSimple())	 	{FAILED_HERE; ok=false; std::cout << "testSimple ... ERROR\n";} 	else std::cout << "testSimple ... ok\n";
   if (!testWhere())	 	{FAILED_HERE; ok=false; std::cout << "testWhere ... ERROR\n";} 	else std::cout << "testWhere ... ok\n";
+#ifndef NLOG
+  if (!testNumberFormat())	{FAILED_HERE; ok=false; std::cout << "testNumberFormat ... ERROR\n";}	else std::cout << "testNumberFormat ... ok\n";
+#endif
   if (!testTypes())	 	{FAILED_HERE; ok=false; std::cout << "testTypes ... ERROR\n";} 		else std::cout << "testTypes ... ok\n";
+  if (!testTraits())	 	{FAILED_HERE; ok=false; std::cout << "testTraits ... ERROR\n";} 		else std::cout << "testTraits ... ok\n";
   if (!testHeavyScope()) 	{FAILED_HERE; ok=false; std::cout << "testHeavyScope ... ERROR\n";} 	else std::cout << "testHeaveScope ... ok\n";
   if (!testHeavyScopeNoXml()) 	{FAILED_HERE; ok=false; std::cout << "testHeavyScopeNoXML ... ERROR\n";} else std::cout << "testHeaveScopeNoXML ... ok\n";
   if (!testFileXml()) 		{FAILED_HERE; ok=false; std::cout << "testFileXml ... ERROR\n";}	else std::cout << "testHeavyXml ... ok\n";
@@ -358,6 +1275,33 @@ int main(UNUSED int argc, UNUSED char *argv[]) {
   if (!testScopeWithMsgLvl()) {FAILED_HERE; ok=false; std::cout << "testScopeWithMsgLvl ... ERROR\n";}	 	else std::cout << "testScopeWithMsgLvl ... ok\n";
 
   if (!testPointer())           {FAILED_HERE; ok=false; std::cout << "testPointer ... ERROR\n";}	else std::cout << "testPointer ... ok\n";
+  if (!testEnabled())           {FAILED_HERE; ok=false; std::cout << "testEnabled ... ERROR\n";}	else std::cout << "testEnabled ... ok\n";
+  if (!testAsync())             {FAILED_HERE; ok=false; std::cout << "testAsync ... ERROR\n";}	else std::cout << "testAsync ... ok\n";
+#ifndef NLOG
+  if (!testScopeCache())        {FAILED_HERE; ok=false; std::cout << "testScopeCache ... ERROR\n";}	else std::cout << "testScopeCache ... ok\n";
+#endif
+  if (!testSinks())             {FAILED_HERE; ok=false; std::cout << "testSinks ... ERROR\n";}	else std::cout << "testSinks ... ok\n";
+  if (!testBinary())            {FAILED_HERE; ok=false; std::cout << "testBinary ... ERROR\n";}	else std::cout << "testBinary ... ok\n";
+  if (!testMmapSink())          {FAILED_HERE; ok=false; std::cout << "testMmapSink ... ERROR\n";}	else std::cout << "testMmapSink ... ok\n";
+  if (!testRotation())          {FAILED_HERE; ok=false; std::cout << "testRotation ... ERROR\n";}	else std::cout << "testRotation ... ok\n";
+#ifdef SLOGCXX_ZLIB
+  if (!testGzipSink())          {FAILED_HERE; ok=false; std::cout << "testGzipSink ... ERROR\n";}	else std::cout << "testGzipSink ... ok\n";
+#endif
+  if (!testRateLimit())         {FAILED_HERE; ok=false; std::cout << "testRateLimit ... ERROR\n";}	else std::cout << "testRateLimit ... ok\n";
+  if (!testLevelFloor())        {FAILED_HERE; ok=false; std::cout << "testLevelFloor ... ERROR\n";}	else std::cout << "testLevelFloor ... ok\n";
+  if (!testLoggers())           {FAILED_HERE; ok=false; std::cout << "testLoggers ... ERROR\n";}	else std::cout << "testLoggers ... ok\n";
+  if (!testCollapse())          {FAILED_HERE; ok=false; std::cout << "testCollapse ... ERROR\n";}	else std::cout << "testCollapse ... ok\n";
+  if (!testConfig())            {FAILED_HERE; ok=false; std::cout << "testConfig ... ERROR\n";}	else std::cout << "testConfig ... ok\n";
+  if (!testCrashHandler())      {FAILED_HERE; ok=false; std::cout << "testCrashHandler ... ERROR\n";}	else std::cout << "testCrashHandler ... ok\n";
+  if (!testFlushPolicy())       {FAILED_HERE; ok=false; std::cout << "testFlushPolicy ... ERROR\n";}	else std::cout << "testFlushPolicy ... ok\n";
+  if (!testTimeFormat())        {FAILED_HERE; ok=false; std::cout << "testTimeFormat ... ERROR\n";}	else std::cout << "testTimeFormat ... ok\n";
+#ifdef CONCURRENT_BOOST
+  if (!testThreads())           {FAILED_HERE; ok=false; std::cout << "testThreads ... ERROR\n";}	else std::cout << "testThreads ... ok\n";
+  if (!testAsyncThreads())      {FAILED_HERE; ok=false; std::cout << "testAsyncThreads ... ERROR\n";}	else std::cout << "testAsyncThreads ... ok\n";
+  if (!testScopeOrder())        {FAILED_HERE; ok=false; std::cout << "testScopeOrder ... ERROR\n";}	else std::cout << "testScopeOrder ... ok\n";
+  if (!testLevelThreads())      {FAILED_HERE; ok=false; std::cout << "testLevelThreads ... ERROR\n";}	else std::cout << "testLevelThreads ... ok\n";
+  if (!testSinkChangeThreads()) {FAILED_HERE; ok=false; std::cout << "testSinkChangeThreads ... ERROR\n";}	else std::cout << "testSinkChangeThreads ... ok\n";
+#endif
 
   // std::cout << "early"<< endl;exit(EXIT_FAILURE); // Use this line to run a subset of tests
 
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////
+//
+/// \file
+/// \brief Read a compressed log from SlogGzipSink, and follow it as it grows
+///
+/// Copyright (c) 2006 Kurt Schwehr
+///     Data Visualization Research Lab,
+/// 	Center for Coastal and Ocean Mapping
+///	University of New Hampshire.
+///	http://ccom.unh.edu
+///
+/// SlogGzipSink does a zlib sync flush after every block, so everything
+/// it has handed over can be read even though the file is not finished.
+/// gunzip reads finished files too, but it stops with an error at the end
+/// of one that is still being written.
+///
+/// usage: slogcxx-zcat [-f] [-n lines] file.gz
+///
+///  -f  keep reading as the file grows, like tail -f
+///  -n  only print the last lines that are already there
+///
+/// Pipe it into slogcxx-decode for a FORMAT_BINARY log.
+//////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <zlib.h>
+
+/// Prints whole output, or holds on to the last lines until the end of the file is reached
+class Output {
+public:
+	explicit Output(const std::size_t tailLines) : tailLines(tailLines), holding(0<tailLines) {}
+	void add(const char *data, const std::size_t len) {
+		if (!holding) {
+			std::cout.write(data, len);
+			return;
+		}
+		partial.append(data, len);
+		std::size_t start = 0;
+		for (std::size_t nl; std::string::npos!=(nl=partial.find('\n',start)); start=nl+1) {
+			lines.push_back(partial.substr(start, nl+1-start));
+			if (lines.size()>tailLines) lines.pop_front();
+		}
+		partial.erase(0, start);
+	}
+	/// Reached the end of what was there.  Print what was held and stop holding.
+	void caughtUp(void) {
+		if (holding) {
+			for (std::size_t i=0; i<lines.size(); i++) std::cout << lines[i];
+			std::cout << partial;
+			lines.clear();
+			partial.clear();
+			holding = false;
+		}
+		std::cout.flush();
+	}
+private:
+	std::size_t tailLines;	///< How many lines to hold
+	bool holding;		///< Still reading what was in the file at the start
+	std::deque<std::string> lines;	///< The last tailLines whole lines
+	std::string partial;	///< A line that has not ended yet
+};
+
+int main(int argc, char *argv[]) {
+	bool follow = false;
+	std::size_t tailLines = 0;
+	int opt;
+	while (-1!=(opt=getopt(argc, argv, "fn:"))) {
+		switch (opt) {
+		case 'f': follow = true; break;
+		case 'n': tailLines = strtoul(optarg, 0, 10); break;
+		default:
+			std::cerr << "usage: " << argv[0] << " [-f] [-n lines] file.gz" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind+1!=argc) {
+		std::cerr << "usage: " << argv[0] << " [-f] [-n lines] file.gz" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::ifstream in(argv[optind], std::ios::in | std::ios::binary);
+	if (!in.is_open()) {
+		std::cerr << argv[0] << ": unable to open " << argv[optind] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (Z_OK!=inflateInit2(&stream, 15+32)) { // 32 accepts a gzip or zlib header
+		std::cerr << argv[0] << ": unable to start zlib" << std::endl;
+		return EXIT_FAILURE;
+	}
+	Output output(tailLines);
+	static char inBuf[65536];
+	static char outBuf[65536];
+	for (;;) {
+		in.read(inBuf, sizeof(inBuf));
+		const std::streamsize got = in.gcount();
+		if (0==got) {
+			output.caughtUp();
+			if (!follow) break;
+			in.clear(); // Clear the end of file and wait for more
+			usleep(250000);
+			continue;
+		}
+		stream.next_in = reinterpret_cast<Bytef *>(inBuf);
+		stream.avail_in = got;
+		do {
+			stream.next_out = reinterpret_cast<Bytef *>(outBuf);
+			stream.avail_out = sizeof(outBuf);
+			const int result = inflate(&stream, Z_NO_FLUSH);
+			output.add(outBuf, sizeof(outBuf)-stream.avail_out);
+			if (Z_STREAM_END==result) inflateReset(&stream); // Appending starts another gzip member
+			else if (Z_OK!=result && Z_BUF_ERROR!=result) {
+				output.caughtUp();
+				std::cerr << argv[0] << ": " << argv[optind] << " is damaged: "
+					  << (stream.msg ? stream.msg : "unknown error") << std::endl;
+				return EXIT_FAILURE;
+			}
+		} while (0<stream.avail_in || 0==stream.avail_out); // Out may have filled up with more to come
+	}
+	inflateEnd(&stream);
+	return EXIT_SUCCESS;
+}
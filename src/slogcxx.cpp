@@ -9,7 +9,6 @@
 ///	http://ccom.unh.edu
 ///
 /// \bug FIX: make namespaces work
-/// \todo get tv_usec into the time.
 /// \todo Optionally for XML mode, 
 ///       look for the closing tag of the previous log and clip it so the logs blend.
 ///
@@ -18,19 +17,33 @@
 //////////////////////////////////////////////////////////////////////
 
 // C headers
-#include <ctime> // for time() to log the time
+#include <ctime> // clock_gettime, gmtime_r and strftime for time stamps
+#include <cstdio> // snprintf for floating point
+#include <cstdlib> // strtod to check floating point round trips
+#include <cstring> // strlen, memcpy
+#include <cfloat> // DBL_DIG, FLT_DIG
+#if __cplusplus >= 201703L
+#include <charconv> // std::to_chars does shortest round trip floating point directly
+#endif
 
 // WinDoze stuff
 #ifdef WIN32
 #include <sys/types.h>
 #include <sys/timeb.h>
+#include <sys/stat.h> // stat to see if a config file changed
 #else
 #include <sys/time.h>
+#include <sys/mman.h> // mmap for SlogMmapSink
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <csignal> // sigaction for the crash handler and SIGHUP
+#include <cerrno>
 #endif
 
 
 // C++ headers
+#include <algorithm> // find
 #include <sstream> // stringstream to convert values into strings
 #include <iostream> // cerr
 
@@ -39,6 +52,10 @@
 #include "boost/date_time/posix_time/posix_time.hpp"
 #endif
 
+#ifdef SLOGCXX_ZLIB
+#include <zlib.h>
+#endif
+
 // Local headers
 #include "slogcxx.h"
 
@@ -46,286 +63,2314 @@ using namespace std;  // this must be after slogcxx.h to make sure we use std co
 //using namespace slogcxx;  // FIX: would be nice to have namespaces
 
 
-Where::Where(const std::string &_file, const int _lineno, const std::string &_function)
-: file(_file), lineno(_lineno), function(_function)
-{
-	// Nothin
+
+/// Read a clock in microseconds.  The monotonic clock counts from some arbitrary start.
+static SlogLongLong readRawClock(const SlogClockSource source) {
+#ifdef WIN32
+	(void)source;
+	timeb timebuffer;
+	ftime(&timebuffer);
+	return timebuffer.time*SlogLongLong(1000000) + timebuffer.millitm*1000;
+#elif defined(_POSIX_TIMERS) && 0<_POSIX_TIMERS
+	timespec ts;
+	clockid_t id = CLOCK_REALTIME;
+#ifdef _POSIX_MONOTONIC_CLOCK
+	if (CLOCK_SOURCE_MONOTONIC==source) id = CLOCK_MONOTONIC;
+#endif
+#ifdef CLOCK_REALTIME_COARSE
+	if (CLOCK_SOURCE_COARSE==source) id = CLOCK_REALTIME_COARSE;
+#endif
+	clock_gettime(id,&ts);
+	return ts.tv_sec*SlogLongLong(1000000) + ts.tv_nsec/1000;
+#else
+	(void)source;
+	timeval timebuffer;
+	gettimeofday(&timebuffer,NULL);
+	return timebuffer.tv_sec*SlogLongLong(1000000) + timebuffer.tv_usec;
+#endif
+}
+
+/// Seconds from an arbitrary start, for deciding when the log file buffer is due to be written
+static double secondsNow(void) {
+	return readRawClock(CLOCK_SOURCE_MONOTONIC)/1000000.0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Binary records
+//////////////////////////////////////////////////////////////////////
+
+// The binary format writes int as 4 bytes and long long as 8, in the byte order of the machine.
+
+/// Bytes in front of every record: the type and the payload length
+#define SLOG_BIN_RECORD_HEAD 5
+
+/// Append the raw bytes of v
+template <typename T>
+static void binaryAppend(std::string &out, const T v) {
+	out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+/// Append the start of a record whose payload is len bytes
+static void binaryRecord(std::string &out, const char type, const std::size_t len) {
+	out += type;
+	binaryAppend<unsigned>(out, len);
+}
+
+/// Append a length and the characters
+static void binaryString(std::string &out, const char *str, const std::size_t len) {
+	binaryAppend<unsigned>(out, len);
+	out.append(str, len);
+}
+
+/// Take a value off the front of p.  @return false if there is not enough left
+template <typename T>
+static bool binaryRead(const char *&p, const char *end, T &v) {
+	if (std::size_t(end-p) < sizeof(v)) return false;
+	memcpy(&v, p, sizeof(v)); // p may not be aligned
+	p += sizeof(v);
+	return true;
+}
+
+/// Take a length and that many characters off the front of p
+static bool binaryReadString(const char *&p, const char *end, std::string &str) {
+	unsigned len;
+	if (!binaryRead(p, end, len) || std::size_t(end-p) < len) return false;
+	str.assign(p, len);
+	p += len;
+	return true;
 }
 
+/// Append the record that starts a binary log
+static void binaryHeader(std::string &out) {
+	binaryRecord(out, SLOG_BIN_HEADER, 8+4+4);
+	out.append("slogcxx", 8); // With the nul
+	binaryAppend<unsigned>(out, 0x01020304);
+	binaryAppend<unsigned>(out, SLOG_BINARY_VERSION);
+}
 
 //////////////////////////////////////////////////////////////////////
 // Slog class methods
 //////////////////////////////////////////////////////////////////////
 
 
-Slog::Slog(const std::string &filename, const std::string &indentStr,
-		   const bool append, const bool enableXml, const bool enableTime, const bool enableLocation)
-: logLevel(1), msgLevel(1), curStr(""),
-xmlEnabled(enableXml), timeEnabled(enableTime), locationEnabled(enableLocation)//, stateIndent(" ")//("\t")
-,stateIndent(indentStr)
-{
-	if (0<filename.size()) {
-		if (1<=logLevel) cerr << "Opening log file: '" << filename << "'" << endl;
-		if (append) logFile.open(filename.c_str(),ios::out | ios::app);
-		else {
-			logFile.open(filename.c_str(),ios::out); // Overwrite the old file
-			logFile.setf(ios::fixed, ios::floatfield);
-		}
-		assert (logFile.is_open());
-		if (xmlEnabled) logFile << "<slogcxx>"<<endl;
+//////////////////////////////////////////////////////////////////////
+// Sinks
+//////////////////////////////////////////////////////////////////////
+
+void
+SlogConsoleSink::write(UNUSED const int lvl, const std::string &text) {
+	out.write(text.data(), text.size()); // cerr is unbuffered
+}
+
+void
+SlogConsoleSink::flush(void) {
+	out.flush();
+}
+
+#ifndef WIN32
+/// write(2) all of len, from a signal handler
+static void crashWriteFd(const int fd, const char *text, std::size_t len) {
+	while (0<len && 0<=fd) {
+		const ssize_t done = ::write(fd, text, len);
+		if (0>done && EINTR==errno) continue;
+		if (0>=done) return; // Nothing else to try
+		text += done;
+		len -= done;
 	}
-	entry(ALWAYS,"started logging");
 }
+#endif
 
-void Slog::AddLogFileOutput(const std::string& filename, const bool append)
+void
+SlogConsoleSink::crashWrite(UNUSED const char *text, UNUSED const std::size_t len) {
+#ifndef WIN32
+	if (&std::cerr==&out) crashWriteFd(STDERR_FILENO, text, len);
+#endif
+}
+
+SlogFileSink::SlogFileSink(const std::string &filename, const bool append,
+			   const SlogSinkFormat format, const int level)
+: SlogSink(format,level), filename(filename), file(new std::ofstream), spare(0), renameFailed(false)
+,fd(-1), spareFd(-1)
+,spareBytes(0), fileBytes(0), opened(0)
+,rotateBytes(0), rotateSeconds(0), rotateKeep(0), rotations(0)
+#ifdef CONCURRENT_BOOST
+,m_rotator(0), m_spareReady(true)
+#endif
+,flushBytes(0), flushSeconds(0), flushLevel(ALWAYS), lastFlush(0)
 {
+	// buffer does the buffering, so have the stream hand big writes straight to the OS
+	file->rdbuf()->pubsetbuf(0,0);
+	if (append) file->open(filename.c_str(),ios::out | ios::app);
+	else file->open(filename.c_str(),ios::out); // Overwrite the old file
+	assert (file->is_open());
+#ifndef WIN32
+	// The stream does not give out its descriptor.  Appending puts writes where the stream would.
+	if (file->is_open()) fd = open(filename.c_str(), O_WRONLY | O_APPEND);
+#endif
+	file->seekp(0,ios::end);
+	const std::streamoff size = file->tellp();
+	fileBytes = 0<size ? size : 0; // Appending counts toward rotation
+	setFlushPolicy(65536,1.0,LACONIC);
+	if (FORMAT_XML==getFormat()) buffer += "<slogcxx>\n";
+	if (FORMAT_BINARY==getFormat()) binaryHeader(buffer);
+	fileBytes += buffer.size();
+	lastFlush = opened = secondsNow();
+}
+
+SlogFileSink::~SlogFileSink() {
 #ifdef CONCURRENT_BOOST
-	boost::mutex::scoped_lock st_lock(m_stateMutex);
+	if (m_rotator) {
+		m_rotator->join();
+		delete m_rotator;
+	}
 #endif
-	if (logFile.is_open()) {
-		// Terminate previous file and start with new one
-		if (xmlEnabled) logFile << "</slogcxx>"<<endl;
-		logFile.flush(); // Be extra sure that everything is written out.
-		logFile.close();
+	if (FORMAT_XML==getFormat()) buffer += "</slogcxx>\n";
+	flush();
+	delete file; // Closes it
+	if (spare) {
+		delete spare;
+		std::remove(spareName.c_str());
 	}
-	if (0<filename.size()) {
-		if (1<=logLevel) cerr << "Opening log file: '" << filename << "'" << endl;
-		if (append) logFile.open(filename.c_str(),ios::out | ios::app);
-		else {
-			logFile.open(filename.c_str(),ios::out); // Overwrite the old file
-			logFile.setf(ios::fixed, ios::floatfield);
-		}
-		assert (logFile.is_open());
-		if (xmlEnabled) logFile << "<slogcxx>"<<endl;
+#ifndef WIN32
+	if (0<=fd) ::close(fd);
+	if (0<=spareFd) ::close(spareFd);
+#endif
+}
+
+void
+SlogFileSink::write(const int lvl, const std::string &text) {
+	if (!isOpen()) return;
+	if (buffer.empty()) lastFlush = secondsNow(); // Start the clock on the oldest output
+	buffer += text;
+	fileBytes += text.size();
+	if ((0<rotateBytes && fileBytes >= rotateBytes)
+		|| (0<rotateSeconds && secondsNow()-opened >= rotateSeconds))
+		rotate(); // This record is the last one in the old file
+	if (buffer.size() >= flushBytes || lvl <= flushLevel
+		|| (0 < flushSeconds && secondsNow()-lastFlush >= flushSeconds))
+		flush();
+}
+
+void
+SlogFileSink::flush(void) {
+	if (!buffer.empty() && isOpen()) {
+		file->write(buffer.data(), buffer.size());
+		file->flush();
 	}
+	buffer.clear(); // Keeps the capacity
+	lastFlush = secondsNow();
+}
+
+void
+SlogFileSink::crashFlush(void) {
+#ifndef WIN32
+	crashWriteFd(fd, buffer.data(), buffer.size());
+#endif
 }
 
+void
+SlogFileSink::crashWrite(UNUSED const char *text, UNUSED const std::size_t len) {
+#ifndef WIN32
+	crashWriteFd(fd, text, len);
+#endif
+}
 
-Slog::~Slog() {
+void
+SlogFileSink::crashClose(void) {
+#ifndef WIN32
+	if (FORMAT_XML==getFormat()) crashWrite("</slogcxx>\n", 11);
+	if (0<=fd) fsync(fd);
+#endif
+}
+
+void
+SlogFileSink::setRotation(const std::size_t bytes, const double seconds, const unsigned keep) {
 #ifdef CONCURRENT_BOOST
-	boost::mutex::scoped_lock st_lock(m_stateMutex);
-	boost::mutex::scoped_lock ac_lock(m_accumulatorMutex);
+	if (m_rotator) {
+		m_rotator->join(); // It uses these settings
+		delete m_rotator;
+		m_rotator = 0;
+	}
 #endif
-	if (0<stateStack.size()) {
-		cerr << "WARNING: shutting down the logger with open scopes.\n" 
-		<< "  I hope you know what you are doing" << endl;
-		const int depth=stateStack.size();
-		for (int i=0;i<depth;i++) popState();
+	rotateBytes = bytes;
+	rotateSeconds = seconds;
+	rotateKeep = keep;
+	const bool rotating = 0<bytes || 0<seconds;
+	if (rotating && !spare && !renameFailed) openSpare(getFormat());
+	if (!rotating && spare) {
+		delete spare;
+		spare = 0;
+#ifndef WIN32
+		if (0<=spareFd) ::close(spareFd);
+		spareFd = -1;
+#endif
+		std::remove(spareName.c_str());
 	}
-	if (!curStr.empty()) {
-		cerr << "WARNING: shutting down with uncompleted partial log message!\n  FORCING COMPLETE\n";
-		complete();
+}
+
+void
+SlogFileSink::rotate(void) {
+#ifdef CONCURRENT_BOOST
+	if (!m_spareReady.load()) return; // Still finishing the last one.  Try again on a later write.
+	if (m_rotator) {
+		m_rotator->join(); // Just returning from retire()
+		delete m_rotator;
+		m_rotator = 0;
 	}
-#ifndef WIN32  //ifdef'd out by mdp 12/14/2007 because using strstream during shutdown causes errors on WIN32
-	entry(ALWAYS,"stopped logging");
 #endif
-	if (logFile.is_open()) {
-		if (xmlEnabled) logFile << "</slogcxx>"<<endl;
-		logFile.flush(); // Be extra sure that everything is written out.
-		logFile.close();
+	if (!spare) return; // openSpare() or retire() already complained
+	// All the hot path does is swap streams and buffers
+	const SlogSinkFormat format = getFormat(); // The retiring thread must not read it
+	std::string *tail = new std::string;
+	tail->swap(buffer);
+	buffer.reserve(flushBytes);
+	if (FORMAT_XML==format) *tail += "</slogcxx>\n";
+	std::ofstream *old = file;
+	file = spare;
+	spare = 0;
+	const int oldFd = fd;
+	fd = spareFd;
+	spareFd = -1;
+	fileBytes = spareBytes;
+	opened = secondsNow();
+	rotations++;
+#ifdef CONCURRENT_BOOST
+	m_spareReady.store(false);
+	m_rotator = new boost::thread(&SlogFileSink::retire, this, old, tail, oldFd, spareName, format);
+#else
+	retire(old, tail, oldFd, spareName, format);
+#endif
+}
+
+/// name.number
+static std::string numberedName(const std::string &name, const unsigned number) {
+	char num[SLOG_NUMBER_BUFSIZE];
+	return name + '.' + std::string(num, slogFormatUnsigned(num, number));
+}
+
+void
+SlogFileSink::retire(std::ofstream *old, std::string *tail, UNUSED const int oldFd, const std::string current,
+		     const SlogSinkFormat format) {
+	old->write(tail->data(), tail->size());
+	delete old; // Closes it
+	delete tail;
+#ifndef WIN32
+	if (0<=oldFd) ::close(oldFd);
+#endif
+	// The current file is still called current, so filename is free to move along
+	for (unsigned i=rotateKeep; 0<i; i--) {
+		const std::string to = numberedName(filename, i);
+		const std::string from = 1<i ? numberedName(filename, i-1) : filename;
+		std::remove(to.c_str()); // rename() does not replace files everywhere
+		std::rename(from.c_str(), to.c_str());
 	}
+	std::remove(filename.c_str()); // Only still there if keep is 0
+	if (0!=std::rename(current.c_str(), filename.c_str())) {
+		// Leave the records where they are.  Rotating again would move the wrong files.
+		cerr << "SlogFileSink: unable to rename " << current << " to " << filename << ".  Not rotating." << endl;
+		renameFailed = true;
+	} else openSpare(format);
+#ifdef CONCURRENT_BOOST
+	m_spareReady.store(true);
+#endif
 }
 
-// See also operator<< on a Where class object
-// FIX: consider removing this from the interface.
-bool Slog::where(const std::string &file, const int lineno, const std::string &function) {
-	stringstream sstr;
-	if (xmlEnabled) {
-		sstr << "<where file=\""<<file<<"\" line=\""<<lineno<<"\" function=\""<<function+"\"/>";
-	} else {
-		// NO XML
-		sstr << "("<<file<<":"<<lineno<<":"<<function+")";
+void
+SlogFileSink::openSpare(const SlogSinkFormat format) {
+	// Never truncate: a file already there is the current one or records a crash left behind
+	spareName = filename + ".next";
+#ifndef WIN32
+	int newFd;
+	for (unsigned i=1; (newFd = open(spareName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0666)) < 0
+		     && EEXIST==errno && i<100; i++)
+		spareName = numberedName(filename + ".next", i);
+	if (newFd < 0) {
+		cerr << "SlogFileSink: unable to make " << spareName << ".  Not rotating." << endl;
+		return;
 	}
-	partial(getMsgLevel(),sstr.str());
+#endif
+	spare = new std::ofstream;
+	spare->rdbuf()->pubsetbuf(0,0);
+	spare->open(spareName.c_str(), ios::out | ios::app);
+	if (!spare->is_open()) {
+		cerr << "SlogFileSink: unable to open " << spareName << ".  Not rotating." << endl;
+		delete spare;
+		spare = 0;
+#ifndef WIN32
+		::close(newFd);
+		std::remove(spareName.c_str());
+#endif
+		return;
+	}
+#ifndef WIN32
+	spareFd = newFd;
+#endif
+	spareBytes = 0;
+	if (FORMAT_XML==format) {
+		const char start[] = "<slogcxx>\n";
+		spare->write(start, sizeof(start)-1);
+		spareBytes = sizeof(start)-1;
+	}
+}
+
+void
+SlogFileSink::setFlushPolicy(const std::size_t bytes, const double seconds, const int level) {
+	flushBytes = bytes;
+	flushSeconds = seconds;
+	flushLevel = level;
+	if (buffer.capacity() < bytes) buffer.reserve(bytes);
+}
+
+#ifndef WIN32
+SlogMmapSink::SlogMmapSink(const std::string &filename, const bool append,
+			   const SlogSinkFormat format, const int level, const std::size_t chunk)
+: SlogSink(format,level), fd(-1), map(0), mapped(0), used(0)
+{
+	const std::size_t page = sysconf(_SC_PAGESIZE);
+	chunkSize = (std::max(chunk,page)+page-1)/page*page;
+	fd = open(filename.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+	assert(0<=fd);
+	if (0>fd) return;
+	struct stat info;
+	if (0!=fstat(fd,&info)) {
+		::close(fd);
+		fd = -1;
+		return;
+	}
+	used = info.st_size; // So a failure cuts the file back to what it was
+	if (!grow(used)) return;
+	// A text log left behind by a crash ends in the nul bytes of the unused chunk.  Binary
+	// records can end in nul bytes, so those are left alone for SlogDecoder to skip.
+	if (FORMAT_BINARY!=getFormat())
+		while (0<used && '\0'==map[used-1]) used--;
+	std::string start;
+	if (FORMAT_XML==getFormat()) start = "<slogcxx>\n";
+	if (FORMAT_BINARY==getFormat()) binaryHeader(start);
+	if (!start.empty()) write(ALWAYS,start);
+}
+
+SlogMmapSink::~SlogMmapSink() {
+	if (FORMAT_XML==getFormat()) write(ALWAYS,"</slogcxx>\n");
+	close();
+}
+
+void
+SlogMmapSink::write(UNUSED const int lvl, const std::string &text) {
+	if (used+text.size() > mapped && !grow(used+text.size())) return;
+	memcpy(map+used, text.data(), text.size());
+	used += text.size();
+}
+
+void
+SlogMmapSink::flush(void) {
+	if (map) msync(map, mapped, MS_ASYNC);
+}
+
+void
+SlogMmapSink::crashWrite(const char *text, const std::size_t len) {
+	if (!map || used+len > mapped) return;
+	memcpy(map+used, text, len);
+	used += len;
+}
+
+void
+SlogMmapSink::crashClose(void) {
+	if (FORMAT_XML==getFormat()) crashWrite("</slogcxx>\n", 11);
+	if (0>fd) return;
+	// The pages are in the page cache already.  Cut off the unused chunk and get them to disk.
+	if (0!=ftruncate(fd, used)) return;
+	fsync(fd);
+}
+
+bool
+SlogMmapSink::grow(const std::size_t needed) {
+	if (map && needed <= mapped) return true;
+	const std::size_t size = (std::max<std::size_t>(needed,1)+chunkSize-1)/chunkSize*chunkSize;
+	// Allocate the blocks now.  Running out of disk under a mapping is a SIGBUS, not an error code.
+#if defined(__APPLE__)
+	const bool allocated = 0==ftruncate(fd, size);
+#else
+	const bool allocated = 0==posix_fallocate(fd, 0, size);
+#endif
+	if (map) munmap(map, mapped);
+	map = 0;
+	void *region = allocated ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (MAP_FAILED==region) {
+		cerr << "SlogMmapSink: unable to grow the log file to " << size << " bytes" << endl;
+		close(); // Stop rather than write past the end
+		return false;
+	}
+	map = static_cast<char *>(region);
+	mapped = size;
 	return true;
 }
 
-std::string& Slog::format_location(const bool xmlOutput) const
+void
+SlogMmapSink::close(void) {
+	if (map) munmap(map, mapped);
+	map = 0;
+	if (0<=fd) {
+		if (0!=ftruncate(fd, used)) cerr << "SlogMmapSink: unable to trim the log file" << endl;
+		::close(fd);
+	}
+	fd = -1;
+}
+#endif
+
+#ifdef SLOGCXX_ZLIB
+SlogGzipSink::SlogGzipSink(const std::string &filename, const bool append,
+			   const SlogSinkFormat format, const int level, const int compression)
+: SlogSink(format,level), stream(new z_stream), flushBytes(65536), flushSeconds(1.0), flushLevel(LACONIC), lastFlush(0)
+#ifdef CONCURRENT_BOOST
+,m_compressor(0), m_stop(false), m_busy(false)
+#endif
 {
-	ostringstream os;
-	if (curLocation != Where()) {	
-		std::string filename(curLocation.getFile());
-		// Some systems, including MacOS, given full filenames for __FILE__, which can be pretty distracting
-		// on output.  We therefore attempt to find the leaf-name for the file
-		std::size_t pos;
-		if ((pos = filename.rfind('/')) != filename.npos || (pos = filename.rfind('\\')) != filename.npos)
-			filename = filename.substr(pos+1);
-		
-		if (xmlOutput) {
-			os << "<where file=\"" << filename << "\" line=\"" << curLocation.getLineno()
-			<< "\" function=\"" << curLocation.getFunction() << "\"/>";
-		} else {
-			os << "(" << filename << ":" << curLocation.getLineno() << ":"
-			<< curLocation.getFunction() << ")";
+	file.rdbuf()->pubsetbuf(0,0); // Compressed data goes out in big pieces anyway
+	if (append) file.open(filename.c_str(),ios::out | ios::app | ios::binary);
+	else file.open(filename.c_str(),ios::out | ios::binary);
+	assert (file.is_open());
+	memset(stream, 0, sizeof(*stream));
+	// 16 more window bits asks for a gzip wrapper, so that gunzip and zcat can read it too
+	if (Z_OK!=deflateInit2(stream, compression, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY)) {
+		cerr << "SlogGzipSink: unable to start zlib for " << filename << endl;
+		file.close();
+		return;
+	}
+	if (FORMAT_XML==getFormat()) block += "<slogcxx>\n";
+	if (FORMAT_BINARY==getFormat()) binaryHeader(block);
+	lastFlush = secondsNow();
+#ifdef CONCURRENT_BOOST
+	m_compressor = new boost::thread(&SlogGzipSink::compressLoop, this);
+#endif
+}
+
+SlogGzipSink::~SlogGzipSink() {
+	if (FORMAT_XML==getFormat()) block += "</slogcxx>\n";
+	if (isOpen()) handOff();
+#ifdef CONCURRENT_BOOST
+	if (m_compressor) {
+		{
+			boost::mutex::scoped_lock lock(m_blocksMutex);
+			m_stop = true;
+			m_work.notify_one();
 		}
+		m_compressor->join(); // After it has done the last of the blocks
+		delete m_compressor;
+	}
+#endif
+	if (isOpen()) {
+		compress(0, 0, Z_FINISH);
+		deflateEnd(stream);
+		file.close();
+	}
+	delete stream;
+	for (std::size_t i=0; i<freeBlocks.size(); i++) delete freeBlocks[i];
+}
+
+void
+SlogGzipSink::write(const int lvl, const std::string &text) {
+	if (!isOpen()) return;
+	if (block.empty()) lastFlush = secondsNow(); // Start the clock on the oldest output
+	block += text;
+	if (block.size() >= flushBytes || lvl <= flushLevel
+		|| (0 < flushSeconds && secondsNow()-lastFlush >= flushSeconds))
+		handOff();
+}
+
+void
+SlogGzipSink::flush(void) {
+	if (!isOpen()) return;
+	if (!block.empty()) handOff();
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_blocksMutex);
+	while (!blocks.empty() || m_busy) m_idle.wait(lock);
+#endif
+}
+
+void
+SlogGzipSink::setFlushPolicy(const std::size_t bytes, const double seconds, const int level) {
+	flushBytes = bytes;
+	flushSeconds = seconds;
+	flushLevel = level;
+}
+
+void
+SlogGzipSink::handOff(void) {
+	lastFlush = secondsNow();
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_blocksMutex);
+	std::string *next;
+	if (freeBlocks.empty()) next = new std::string;
+	else {
+		next = freeBlocks.back();
+		freeBlocks.pop_back();
+	}
+	next->swap(block); // block gets the capacity of one that was already compressed
+	blocks.push_back(next);
+	m_work.notify_one();
+#else
+	compress(block.data(), block.size(), Z_SYNC_FLUSH);
+	block.clear();
+#endif
+}
+
+void
+SlogGzipSink::compress(const char *data, const std::size_t len, const int mode) {
+	char out[16384];
+	stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	stream->avail_in = len;
+	// The usual zlib loop: keep going while deflate fills all of out
+	do {
+		stream->next_out = reinterpret_cast<Bytef *>(out);
+		stream->avail_out = sizeof(out);
+		deflate(stream, mode);
+		file.write(out, sizeof(out)-stream->avail_out);
+	} while (0==stream->avail_out);
+	file.flush();
+}
+
+#ifdef CONCURRENT_BOOST
+void
+SlogGzipSink::compressLoop(void) {
+	boost::mutex::scoped_lock lock(m_blocksMutex);
+	for (;;) {
+		while (blocks.empty() && !m_stop) m_work.wait(lock);
+		if (blocks.empty()) break; // Stopping, and nothing is left
+		std::string *next = blocks.front();
+		blocks.pop_front();
+		m_busy = true;
+		lock.unlock();
+		compress(next->data(), next->size(), Z_SYNC_FLUSH);
+		next->clear(); // Keeps the capacity
+		lock.lock();
+		freeBlocks.push_back(next);
+		m_busy = false;
+		if (blocks.empty()) m_idle.notify_all();
+	}
+}
+#endif
+#endif
+
+void
+SlogMemorySink::write(UNUSED const int lvl, const std::string &text) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_recordsMutex);
+#endif
+	records.push_back(text);
+	if (0<maxRecords && records.size()>maxRecords) records.pop_front();
+}
+
+std::vector<std::string>
+SlogMemorySink::getRecords(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_recordsMutex);
+#endif
+	return std::vector<std::string>(records.begin(), records.end());
+}
+
+std::size_t
+SlogMemorySink::size(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_recordsMutex);
+#endif
+	return records.size();
+}
+
+void
+SlogMemorySink::clear(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_recordsMutex);
+#endif
+	records.clear();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Slog class methods
+//////////////////////////////////////////////////////////////////////
+
+
+Slog::Slog(const std::string &filename, const std::string &indentStr,
+		   const bool append, const bool enableXml, const bool enableTime, const bool enableLocation)
+:
+#ifdef CONCURRENT_BOOST
+m_writer(0), m_asyncEnabled(false), m_writerStop(false), m_writerSleeping(false),
+m_queued(0), m_written(0), m_dropped(0), m_crashed(false),
+m_configWatcher(0), m_configStop(false), m_configSeconds(0),
+#endif
+logLevel(1), msgLevel(1),
+xmlEnabled(enableXml), timeEnabled(enableTime), locationEnabled(enableLocation)//, stateIndent(" ")//("\t")
+,stateIndent(indentStr), depthLabel(" 0")
+,rootLog(0), parentLog(0), levelSet(true)
+,configStamp(), configHangups(0)
+,consoleSink(0), fileSink(0)
+,m_snapshot(0), m_gen(0)
+#ifdef CONCURRENT_BOOST
+,m_epoch(0)
+#endif
+,queueSize(0), overflowPolicy(OVERFLOW_BLOCK)
+#ifdef CONCURRENT_BOOST
+,m_ring(0), m_pool(0)
+#endif
+,flushBytes(0), flushSeconds(0), flushLevel(ALWAYS)
+,rotateBytes(0), rotateSeconds(0), rotateKeep(5)
+,timeFormat(TIME_EPOCH_MICROS), clockSource(CLOCK_SOURCE_REALTIME), clockOffset(0)
+,collapseEnabled(false), lastHash(0), lastLevel(0), lastTime(0), lastRepeat(0), repeats(0)
+,binaryArgs(false)
+{
+#ifdef CONCURRENT_BOOST
+	m_readers[0].store(0);
+	m_readers[1].store(0);
+#endif
+	setFlushPolicy();
+	consoleSink = new SlogConsoleSink(cerr);
+	sinks.push_back(consoleSink);
+	writing = sinks;
+	beginChange();
+	publish();
+	if (0<filename.size()) AddLogFileOutput(filename,append);
+	entry(ALWAYS,"started logging");
+}
+
+// No sinks or snapshots: everything goes out through root
+Slog::Slog(Slog *root, Slog *parent, const std::string &loggerName)
+:
+#ifdef CONCURRENT_BOOST
+m_writer(0), m_asyncEnabled(false), m_writerStop(false), m_writerSleeping(false),
+m_queued(0), m_written(0), m_dropped(0), m_crashed(false),
+m_configWatcher(0), m_configStop(false), m_configSeconds(0),
+#endif
+logLevel(parent->logLevel.load()), msgLevel(1),
+xmlEnabled(root->xmlEnabled.load()), timeEnabled(root->timeEnabled.load()), locationEnabled(root->locationEnabled.load())
+,stateIndent(root->stateIndent), depthLabel(" 0")
+,rootLog(root), parentLog(parent), name(loggerName), levelSet(false)
+,configStamp(), configHangups(0)
+,consoleSink(0), fileSink(0)
+,m_snapshot(0), m_gen(0)
+#ifdef CONCURRENT_BOOST
+,m_epoch(0)
+#endif
+,queueSize(0), overflowPolicy(OVERFLOW_BLOCK)
+#ifdef CONCURRENT_BOOST
+,m_ring(0), m_pool(0)
+#endif
+,flushBytes(0), flushSeconds(0), flushLevel(ALWAYS)
+,rotateBytes(0), rotateSeconds(0), rotateKeep(5)
+,timeFormat(TIME_EPOCH_MICROS), clockSource(CLOCK_SOURCE_REALTIME), clockOffset(0)
+,collapseEnabled(false), lastHash(0), lastLevel(0), lastTime(0), lastRepeat(0), repeats(0)
+,binaryArgs(false)
+{
+}
+
+Slog &
+Slog::getLogger(const std::string &loggerName) {
+	if (rootLog) return rootLog->getLogger(loggerName);
+	assert(!loggerName.empty());
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_levelMutex);
+#endif
+	std::map<std::string,Slog*>::iterator found = loggers.find(loggerName);
+	if (loggers.end()!=found) return *found->second;
+	// Make the loggers above it on the way down: "net", then "net.rpc"
+	Slog *parent = this;
+	for (std::string::size_type dot=0;;dot++) {
+		dot = loggerName.find('.',dot);
+		const std::string part(loggerName,0,dot);
+		Slog *&logger = loggers[part];
+		if (!logger) logger = new Slog(this, parent, part);
+		if (std::string::npos==dot) return *logger;
+		parent = logger;
+	}
+}
+
+void
+Slog::setLevel(const int lvl) {
+	assert(0<=lvl);
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(root().m_levelMutex);
+#endif
+	logLevel = lvl;
+	levelSet = true;
+	passLevelsDown();
+}
+
+int
+Slog::inc(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(root().m_levelMutex);
+#endif
+	const int lvl = logLevel.add(1,INT_MIN);
+	levelSet = true;
+	passLevelsDown();
+	return lvl;
+}
+
+int
+Slog::dec(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(root().m_levelMutex);
+#endif
+	const int lvl = logLevel.add(-1,0);
+	levelSet = true;
+	passLevelsDown();
+	return lvl;
+}
+
+void
+Slog::inheritLevel(void) {
+	if (!parentLog) return; // The top has nothing to follow
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(root().m_levelMutex);
+#endif
+	levelSet = false;
+	passLevelsDown();
+}
+
+void
+Slog::passLevelsDown(void) {
+	// Names sort after the names of the loggers above them, so one pass in order is enough
+	const std::map<std::string,Slog*> &all = root().loggers;
+	for (std::map<std::string,Slog*>::const_iterator logger=all.begin(); logger!=all.end(); logger++) {
+		Slog *l = logger->second;
+		if (!l->levelSet) l->logLevel = l->parentLog->logLevel.load();
+	}
+}
+
+void Slog::AddLogFileOutput(const std::string& filename, const bool append)
+{
+	if (rootLog) {rootLog->AddLogFileOutput(filename,append); return;}
+	SlogFileSink *file = 0;
+	if (0<filename.size()) {
+		bool xml;
+		{
+#ifdef CONCURRENT_BOOST
+			boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+			xml = xmlEnabled;
+		}
+		file = openLogFile(filename, append, xml);
+	}
+	{
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock op_lock(m_outputMutex);
+		boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+		beginChange();
+		SinkChange *change = newSinkChange();
+		std::vector<SlogSink*> dropped;
+		swapLogFile(file, *change, dropped);
+		changeSinks(change); // Anything still queued goes to the old file
+		publish();
+		dropSinks(dropped);
+	}
+#ifdef CONCURRENT_BOOST
+	drainQueue(); // So the old file is closed by the time this returns
+#endif
+}
+
+SlogFileSink *
+Slog::openLogFile(const std::string &filename, const bool append, const bool xml) {
+	std::size_t bytes, rotate;
+	double seconds, rotateAfter;
+	int level;
+	unsigned keep;
+	{
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+		bytes = flushBytes;
+		seconds = flushSeconds;
+		level = flushLevel;
+		rotate = rotateBytes;
+		rotateAfter = rotateSeconds;
+		keep = rotateKeep;
+	}
+	if (1<=logLevel) cerr << "Opening log file: '" << filename << "'" << endl;
+	SlogFileSink *file = new SlogFileSink(filename, append, xml ? FORMAT_XML : FORMAT_TEXT);
+	file->setFlushPolicy(bytes, seconds, level);
+	if (0<rotate || 0<rotateAfter) file->setRotation(rotate, rotateAfter, keep); // Opens the spare
+	return file;
+}
+
+void
+Slog::swapLogFile(SlogFileSink *file, SinkChange &change, std::vector<SlogSink*> &dropped) {
+	if (fileSink) {
+		// Terminate previous file and start with new one
+		sinks.erase(std::find(sinks.begin(), sinks.end(), fileSink));
+		dropped.push_back(fileSink);
+		fileSink = 0;
+	}
+	if (file) {
+		// In case the settings changed while it was being opened.  Nothing to do if they did not.
+		file->setFlushPolicy(flushBytes, flushSeconds, flushLevel);
+		file->setRotation(rotateBytes, rotateSeconds, rotateKeep);
+		fileSink = file;
+		sinks.push_back(fileSink);
+		if (file->getFormat()!=sinkFormat(file)) change.formats.push_back(std::make_pair(static_cast<SlogSink*>(file), sinkFormat(file)));
+	}
+	change.sinks = sinks;
+}
+
+void
+Slog::addSink(SlogSink *sink) {
+	assert(sink);
+	if (rootLog) {rootLog->addSink(sink); return;}
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	sinks.push_back(sink);
+	SinkChange *change = newSinkChange(); // Records already queued were formatted without it
+	if (FORMAT_BINARY==sink->getFormat()) {
+		binaryArgs = true; // Messages are built as arguments from now on
+		startBinarySink(sink, *change);
+	}
+	changeSinks(change);
+	publish();
+}
+
+void
+Slog::startBinarySink(SlogSink *sink, SinkChange &change) {
+	// Send every definition again when it is next used.  Sinks that already had them just
+	// get repeats.
+	for (std::size_t i=0; i<binarySites.size(); i++) binarySites[i].defined = false;
+	scopeDefined.assign(scopeDefined.size(), false);
+	// The sink comes in partway down the scope stack
+	std::string out;
+	for (std::vector<std::string>::const_iterator scope=stateStack.begin(); scope!=stateStack.end(); scope++)
+		binaryPush(*scope, out);
+	if (!out.empty()) change.writes.push_back(std::make_pair(sink, out));
+}
+
+bool
+Slog::removeSink(SlogSink *sink) {
+	if (rootLog) return rootLog->removeSink(sink);
+	{
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock op_lock(m_outputMutex);
+		boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+		std::vector<SlogSink*>::iterator found = std::find(sinks.begin(), sinks.end(), sink);
+		if (sinks.end()==found) return false;
+		beginChange();
+		sinks.erase(found);
+		if (consoleSink==sink) consoleSink = 0;
+		if (fileSink==sink) fileSink = 0;
+		binaryArgs = haveSink(FORMAT_BINARY);
+		changeSinks(newSinkChange()); // The sink still gets what was already logged
+		publish();
+		dropSinks(std::vector<SlogSink*>(1, sink));
+	}
+#ifdef CONCURRENT_BOOST
+	drainQueue(); // So it is gone by the time this returns
+#endif
+	return true;
+}
+
+void
+Slog::enableXml(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	SinkChange *change = newSinkChange();
+	setXml(true, *change);
+	changeSinks(change); // Records already queued were formatted for the file as it was
+	publish();
+}
+
+void
+Slog::disableXml(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	SinkChange *change = newSinkChange();
+	setXml(false, *change);
+	changeSinks(change);
+	publish();
+}
+
+void
+Slog::setXml(const bool on, SinkChange &change) {
+	xmlEnabled = on;
+	if (fileSink) change.formats.push_back(std::make_pair(static_cast<SlogSink*>(fileSink), on ? FORMAT_XML : FORMAT_TEXT));
+}
+
+SlogSinkFormat
+Slog::sinkFormat(const SlogSink *sink) const {
+	if (sink==fileSink) return xmlEnabled ? FORMAT_XML : FORMAT_TEXT; // Ahead of the writer
+	return sink->getFormat();
+}
+
+Slog::SinkChange *
+Slog::newSinkChange(void) const {
+	SinkChange *change = new SinkChange;
+	change->swap = true;
+	change->sinks = sinks;
+	return change;
+}
+
+void
+Slog::changeSinks(SinkChange *change) {
+#ifdef CONCURRENT_BOOST
+	if (m_asyncEnabled.load()) {
+		const std::string none[SLOG_FORMAT_COUNT];
+		fillSlot(claimSlot(true), NEVER, true, none, change);
+		return;
+	}
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+#endif
+	applySinkChange(change);
+}
+
+void
+Slog::applySinkChange(SinkChange *change) {
+	if (change->swap) writing = change->sinks;
+	for (std::size_t i=0; i<change->formats.size(); i++) change->formats[i].first->setFormat(change->formats[i].second);
+	for (std::size_t i=0; i<change->writes.size(); i++) change->writes[i].first->write(NEVER, change->writes[i].second);
+	for (std::size_t i=0; i<change->dropped.size(); i++) {
+		change->dropped[i]->flush();
+		delete change->dropped[i]; // File sinks close up their files
+	}
+	delete change;
+}
+
+void
+Slog::dropSinks(const std::vector<SlogSink*> &dropped) {
+	if (dropped.empty()) return;
+#ifdef CONCURRENT_BOOST
+	synchronize(); // Logging threads read the levels of the sinks in their snapshots
+#endif
+	SinkChange *change = new SinkChange;
+	change->dropped = dropped;
+	changeSinks(change); // After the records still on their way to them
+}
+
+
+Slog::~Slog() {
+	// No locking here: popState() and complete() take the locks they need, and nobody else
+	// should be using a logger that is being destroyed.
+	if (rootLog) {
+		// A named logger only has its partial messages to finish
+		if (!accumulator().str.empty()) complete();
+		return;
+	}
+	unwatchConfig(); // A reload could be using the named loggers
+	for (std::map<std::string,Slog*>::iterator logger=loggers.begin(); logger!=loggers.end(); logger++)
+		delete logger->second;
+	disableCrashHandler();
+	if (0<stateStack.size()) {
+		cerr << "WARNING: shutting down the logger with open scopes.\n" 
+		<< "  I hope you know what you are doing" << endl;
+		const int depth=stateStack.size();
+		for (int i=0;i<depth;i++) popState();
+	}
+	if (!accumulator().str.empty()) {
+		cerr << "WARNING: shutting down with uncompleted partial log message!\n  FORCING COMPLETE\n";
+		complete();
+	}
+#ifndef WIN32  //ifdef'd out by mdp 12/14/2007 because using strstream during shutdown causes errors on WIN32
+	entry(ALWAYS,"stopped logging");
+#endif
+	disableAsync(); // Get everything out of the queue before closing up
+	for (std::vector<SlogSink*>::iterator sink=sinks.begin(); sink!=sinks.end(); sink++) {
+		(*sink)->flush();
+		delete *sink; // File sinks close up their files
+	}
+	// Nobody is reading snapshots any more
+	delete &current();
+#ifdef CONCURRENT_BOOST
+	for (std::size_t i=0; i<m_retired.size(); i++) delete m_retired[i].first;
+#endif
+}
+
+// See also operator<< on a Where class object
+// FIX: consider removing this from the interface.
+bool Slog::where(const std::string &file, const int lineno, const std::string &function) {
+	stringstream sstr;
+	if (xmlEnabled) {
+		sstr << "<where file=\""<<file<<"\" line=\""<<lineno<<"\" function=\""<<function+"\"/>";
+	} else {
+		// NO XML
+		sstr << "("<<file<<":"<<lineno<<":"<<function+")";
+	}
+	partial(getMsgLevel(),sstr.str());
+	return true;
+}
+
+void
+Slog::setTimeFormat(const SlogTimeFormat format, const SlogClockSource clock) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	timeFormat = format; // The time stamp caches notice the change for themselves
+	clockSource = clock;
+	// Start the monotonic clock off at the current time of day
+	clockOffset = readRawClock(CLOCK_SOURCE_REALTIME) - readRawClock(CLOCK_SOURCE_MONOTONIC);
+	publish();
+}
+
+/// Split microseconds since 1970 into seconds and the microseconds left over
+static void splitMicros(const SlogLongLong micros, SlogLongLong &second, int &fraction) {
+	second = micros/1000000;
+	fraction = int(micros%1000000);
+	if (0>fraction) {fraction += 1000000; second--;}
+}
+
+/// Write the whole seconds part of a time stamp.  @return its length
+static std::size_t formatSeconds(char *buf, const SlogLongLong second, const SlogTimeFormat format) {
+	if (TIME_ISO8601!=format) return slogFormatSigned(buf, second);
+	const time_t t = time_t(second);
+	tm parts;
+#ifdef WIN32
+	gmtime_s(&parts,&t);
+#else
+	gmtime_r(&t,&parts);
+#endif
+	return strftime(buf, SLOG_TIME_BUFSIZE, "%Y-%m-%dT%H:%M:%S", &parts);
+}
+
+/// Finish a time stamp whose seconds are the first len characters of buf.  @return its length
+static std::size_t formatFraction(char *buf, std::size_t len, int fraction, const SlogTimeFormat format) {
+	buf[len++] = '.';
+	for (int i=5; 0<=i; i--) {
+		buf[len+i] = char('0'+fraction%10);
+		fraction /= 10;
+	}
+	len += 6;
+	if (TIME_ISO8601==format) buf[len++] = 'Z';
+	buf[len] = '\0';
+	return len;
+}
+
+std::size_t
+slogFormatTime(char *buf, const SlogLongLong micros, const SlogTimeFormat format) {
+	SlogLongLong second;
+	int fraction;
+	splitMicros(micros, second, fraction);
+	return formatFraction(buf, formatSeconds(buf, second, format), fraction, format);
+}
+
+SlogLongLong
+Slog::readClock(const Snapshot &snap) {
+	SlogLongLong now = readRawClock(snap.clockSource);
+	if (CLOCK_SOURCE_MONOTONIC==snap.clockSource) now += snap.clockOffset;
+	return now;
+}
+
+std::size_t
+Slog::formatTime(Accumulator &acc, const SlogLongLong micros, const SlogTimeFormat format) {
+	SlogLongLong second;
+	int fraction;
+	splitMicros(micros, second, fraction);
+	// Only the microseconds change within a second, so redo the expensive part once a second
+	if (second!=acc.cachedSecond || format!=acc.cachedFormat) {
+		acc.cachedSecond = second;
+		acc.cachedFormat = format;
+		acc.cachedLen = formatSeconds(acc.timeText, second, format);
+	}
+	return formatFraction(acc.timeText, acc.cachedLen, fraction, format);
+}
+
+bool
+Slog::entry(const int lvl, const std::string &str) {
+	if (!isEnabled(lvl)) return false; // Not powerful enough to get out
+	return output(lvl,str,false,accumulator().location);
+}
+
+bool
+Slog::output(const int lvl, const std::string &str, const bool binary, const Where *curLocation) {
+	if (rootLog) return rootLog->output(lvl,str,binary,curLocation); // Already past this logger's level
+	Accumulator &acc = accumulator(); // This thread's own, so formatting into it needs no lock
+	const Where *location = (locationEnabled ? curLocation : 0);
+#ifdef CONCURRENT_BOOST
+	// Collapsing and binary locations keep tables of what went before, so those entries go
+	// one at a time.  The rest only read the snapshot.
+	boost::mutex::scoped_lock op_lock(m_outputMutex, boost::defer_lock);
+	bool shared = collapseEnabled || (binaryArgs && location);
+#endif
+	for (;;) {
+#ifdef CONCURRENT_BOOST
+		if (shared && !op_lock.owns_lock()) op_lock.lock(); // Before enter(), since changes hold it
+#endif
+		SnapshotReader reader(*this);
+		const Snapshot &snap = reader.get();
+		// Only format for the formats some sink wants this entry in
+		bool wanted[SLOG_FORMAT_COUNT];
+		if (!wantedFormats(snap, lvl, wanted)) return true; // Logged, but nobody is listening at this level
+#ifdef CONCURRENT_BOOST
+		if ((snap.collapse || (wanted[FORMAT_BINARY] && location)) && !op_lock.owns_lock()) {
+			shared = true; // Turned on since we looked
+			continue;
+		}
+#endif
+		const SlogLongLong now = timeEnabled || snap.collapse ? readClock(snap) : LLONG_MIN;
+		if (snap.collapse && collapse(snap, lvl, str, binary, location, now)) return true;
+		unsigned site = 0;
+		if (wanted[FORMAT_BINARY] && location) {
+			// Definitions go to every binary sink, whatever its level, and before anything uses them
+			std::string defs[SLOG_FORMAT_COUNT];
+			site = binaryLocation(*location, defs[FORMAT_BINARY]);
+			if (!defs[FORMAT_BINARY].empty()) write(NEVER, true, defs);
+		}
+		// Format the records here so the writer (this thread or the async one) only has to copy bytes
+		std::string text[SLOG_FORMAT_COUNT];
+		formatEntry(snap, wanted, lvl, str, binary, location, site, now, acc, text);
+		if (commit(snap, lvl, text)) return true;
+		// A change got in ahead of it, so format it again from the new snapshot
+	}
+}
+
+bool
+Slog::wantedFormats(const Snapshot &snap, const int lvl, bool wanted[SLOG_FORMAT_COUNT]) {
+	bool any = false;
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++) wanted[f] = false;
+	for (std::size_t i=0; i<snap.sinks.size(); i++) {
+		const SlogSink *sink = snap.sinks[i];
+		if (lvl <= sink->getLevel()) {
+			wanted[snap.formats[i]] = true;
+			wanted[sink->getFormat()] = true; // Not the same until the writer gets to a format change
+			any = true;
+		}
+	}
+	return any;
+}
+
+void
+Slog::formatEntry(const Snapshot &snap, const bool wanted[SLOG_FORMAT_COUNT], const int lvl, const std::string &str,
+		  const bool binary, const Where *location, const unsigned site, const SlogLongLong now, Accumulator &acc,
+		  std::string text[SLOG_FORMAT_COUNT]) const {
+	// timeEnabled is read once, since another thread may flip it part way through
+	const SlogLongLong micros = timeEnabled && LLONG_MIN!=now ? now : LLONG_MIN;
+	bool anyText = false;
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++)
+		if (wanted[f] && FORMAT_BINARY!=f) anyText = true;
+	if (anyText) {
+		// Binary arguments only become text for the sinks that want text
+		std::string decoded;
+		if (binary) slogDecodeArgs(str.data(), str.size(), decoded);
+		SlogEntry rec;
+		rec.timeLen = LLONG_MIN!=micros ? formatTime(acc, micros, snap.timeFormat) : 0;
+		rec.time = acc.timeText;
+		rec.location = location;
+		rec.message = binary ? &decoded : &str;
+		rec.depthLabel = &snap.depthLabel;
+		rec.indent = &snap.indent;
+		rec.scope = snap.scoped ? &snap.scope : 0;
+		for (int f=0; f<SLOG_FORMAT_COUNT; f++)
+			if (wanted[f] && FORMAT_BINARY!=f) slogFormatEntry(SlogSinkFormat(f), rec, text[f]);
+	}
+	if (wanted[FORMAT_BINARY]) binaryEntry(lvl, micros, site, str, binary, text[FORMAT_BINARY]);
+}
+
+/// FNV-1a 64 bit offset basis and prime, built up from halves since C++98 has no long long literals
+static const SlogULongLong fnvBasis = SlogULongLong(0xcbf29ce4UL)<<32 | 0x84222325UL;
+static const SlogULongLong fnvPrime = SlogULongLong(0x100UL)<<32 | 0x1b3UL;
+
+/// Fold len bytes into a 64 bit FNV-1a hash
+static SlogULongLong fnv1a(SlogULongLong hash, const void *data, const std::size_t len) {
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	for (std::size_t i=0; i<len; i++) {
+		hash ^= p[i];
+		hash *= fnvPrime;
+	}
+	return hash;
+}
+
+bool
+Slog::collapse(const Snapshot &snap, const int lvl, const std::string &str, const bool binary, const Where *location,
+	       const SlogLongLong now) {
+	SlogULongLong hash = fnvBasis;
+	hash = fnv1a(hash, str.data(), str.size());
+	hash = fnv1a(hash, snap.scope.data(), snap.scope.size());
+	hash = fnv1a(hash, &snap.depth, sizeof(snap.depth));
+	hash = fnv1a(hash, &lvl, sizeof(lvl));
+	hash = fnv1a(hash, &binary, sizeof(binary));
+	// By what it says rather than by address: the copies SetLocation() makes all share one
+	const Where where = location ? *location : Where("",0,"");
+	const char *file = where.getFile(), *function = where.getFunction();
+	const int lineno = where.getLineno();
+	hash = fnv1a(hash, &file, sizeof(file));
+	hash = fnv1a(hash, &lineno, sizeof(lineno));
+	hash = fnv1a(hash, &function, sizeof(function));
+	if (hash==lastHash) {
+		repeats++;
+		lastRepeat = now;
+		return true;
+	}
+	flushRepeats();
+	lastHash = hash;
+	lastLevel = lvl;
+	lastTime = now;
+	return false;
+}
+
+void
+Slog::flushRepeats(void) {
+	if (0==repeats) return;
+	const unsigned long count = repeats;
+	repeats = 0;
+	const Snapshot &snap = current(); // Changes call this before they change anything
+	bool wanted[SLOG_FORMAT_COUNT];
+	if (!wantedFormats(snap, lastLevel, wanted)) return; // The sinks changed
+	std::string msg("last message repeated ");
+	char buf[SLOG_TIME_BUFSIZE];
+	msg.append(buf, slogFormatUnsigned(buf, count));
+	msg += 1==count ? " time (first " : " times (first ";
+	msg.append(buf, slogFormatTime(buf, lastTime, snap.timeFormat));
+	msg += ", last ";
+	msg.append(buf, slogFormatTime(buf, lastRepeat, snap.timeFormat));
+	msg += ')';
+	std::string text[SLOG_FORMAT_COUNT];
+	formatEntry(snap, wanted, lastLevel, msg, false, 0, 0, lastRepeat, accumulator(), text);
+	write(lastLevel, false, text); // Before whatever made it come out
+}
+
+void
+Slog::enableCollapse(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	setCollapse(true);
+	publish();
+}
+
+void
+Slog::disableCollapse(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	setCollapse(false);
+	publish();
+}
+
+void
+Slog::setCollapse(const bool on) {
+	if (on) {
+		lastHash = 0; // Start over
+		repeats = 0;
+	} else flushRepeats();
+	collapseEnabled = on;
+}
+
+unsigned
+Slog::binaryLocation(const Where &location, std::string &out) {
+	unsigned &id = siteIds[&location];
+	if (0==id) {
+		const BinarySite site = {0, 0, 0, false};
+		binarySites.push_back(site);
+		id = binarySites.size();
+	}
+	BinarySite &site = binarySites[id-1];
+	// The copies SetLocation() makes share an address, so another call site can turn up at it
+	if (!site.defined || site.file!=location.getFile() || site.lineno!=location.getLineno()
+		|| site.function!=location.getFunction()) {
+		site.file = location.getFile();
+		site.lineno = location.getLineno();
+		site.function = location.getFunction();
+		site.defined = true;
+		const std::size_t fileLen = strlen(site.file);
+		const std::size_t functionLen = strlen(site.function);
+		binaryRecord(out, SLOG_BIN_LOCATION, 4+4+4+fileLen+4+functionLen);
+		binaryAppend<unsigned>(out, id);
+		binaryAppend<int>(out, site.lineno);
+		binaryString(out, site.file, fileLen);
+		binaryString(out, site.function, functionLen);
+	}
+	return id;
+}
+
+void
+Slog::binaryPush(const std::string &scope, std::string &out) {
+	unsigned &id = scopeIds[scope];
+	if (0==id) {
+		scopeDefined.push_back(false);
+		id = scopeDefined.size();
+	}
+	if (!scopeDefined[id-1]) {
+		scopeDefined[id-1] = true;
+		binaryRecord(out, SLOG_BIN_SCOPE, 4+4+scope.size());
+		binaryAppend<unsigned>(out, id);
+		binaryString(out, scope.data(), scope.size());
+	}
+	binaryRecord(out, SLOG_BIN_PUSH, 4);
+	binaryAppend<unsigned>(out, id);
+}
+
+void
+Slog::binaryEntry(const int lvl, const SlogLongLong micros, const unsigned site,
+		  const std::string &str, const bool binary, std::string &out) const {
+	// Text from entry() or from before the binary sink was added goes in as one string
+	const std::size_t argsLen = binary || str.empty() ? str.size() : 1+4+str.size();
+	binaryRecord(out, SLOG_BIN_ENTRY, 4+8+4+argsLen);
+	binaryAppend<int>(out, lvl);
+	binaryAppend<SlogLongLong>(out, micros);
+	binaryAppend<unsigned>(out, site);
+	if (binary) out += str;
+	else SlogBuffer(out, true).append(str);
+}
+
+bool
+Slog::haveSink(const SlogSinkFormat format) const {
+	for (std::vector<SlogSink*>::const_iterator sink=sinks.begin(); sink!=sinks.end(); sink++)
+		if (format==sinkFormat(*sink)) return true;
+	return false;
+}
+
+bool
+Slog::commit(UNUSED const Snapshot &snap, const int lvl, const std::string text[SLOG_FORMAT_COUNT]) {
+#ifdef CONCURRENT_BOOST
+	if (snap.async) {
+		SlogRing<PendingRecord>::Cell *cell = claimSlot(false);
+		if (!cell) return true; // Dropped
+		// Claiming is sequentially consistent, so a change that claimed a slot ahead of this one
+		// has already made m_gen odd
+		if (m_gen.load()==snap.gen) {
+			fillSlot(cell, lvl, false, text);
+			return true;
+		}
+		const std::string none[SLOG_FORMAT_COUNT];
+		fillSlot(cell, lvl, false, none); // Nothing to write, but the writer still has to get past it
+		return false;
+	}
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+	if (m_gen.load()!=snap.gen) return false; // Changes take m_sinkMutex to write, so it was written first
+#endif
+	writeRecord(lvl, false, text);
+	return true;
+}
+
+void
+Slog::write(const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT]) {
+#ifdef CONCURRENT_BOOST
+	if (m_asyncEnabled.load()) {
+		SlogRing<PendingRecord>::Cell *cell = claimSlot(framing);
+		if (cell) fillSlot(cell, lvl, framing, text);
+		return;
+	}
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+#endif
+	writeRecord(lvl, framing, text);
+}
+
+#ifdef CONCURRENT_BOOST
+SlogRing<Slog::PendingRecord>::Cell *
+Slog::claimSlot(const bool keep) {
+	SlogRing<PendingRecord>::Cell *cell;
+	while (!(cell = m_ring->claimPush())) {
+		if (OVERFLOW_DROP_NEWEST==overflowPolicy && !keep) {
+			m_dropped.fetch_add(1);
+			return 0;
+		}
+		if (OVERFLOW_DROP_OLDEST!=overflowPolicy || !dropOldest())
+			boost::this_thread::yield(); // The writer is behind.  Let it catch up.
+	}
+	m_queued.fetch_add(1); // Now rather than when filled, so flush() waits for it
+	return cell;
+}
+
+bool
+Slog::dropOldest(void) {
+	// Only tried, so a full ring never makes a logging thread wait for a lock.  The writer
+	// takes records out holding it too, so changes are still made in order.
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex, boost::try_to_lock);
+	if (!sink_lock.owns_lock()) return false; // The writer is making room anyway
+	SlogRing<PendingRecord>::Cell *oldest = m_ring->claimPop();
+	if (!oldest) return false; // Still being filled by another thread
+	int lvl;
+	bool framing;
+	std::string text[SLOG_FORMAT_COUNT];
+	if (SinkChange *change = takeSlot(oldest, lvl, framing, text)) applySinkChange(change);
+	else if (framing) writeRecord(lvl, framing, text); // Dropping it would unbalance the scopes
+	else m_dropped.fetch_add(1);
+	m_written.fetch_add(1); // So flush() does not wait for it
+	return true;
+}
+
+void
+Slog::fillSlot(SlogRing<PendingRecord>::Cell *cell, const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT],
+	       SinkChange *change) {
+	PendingRecord &r = cell->data;
+	r.level = lvl;
+	r.framing = framing;
+	r.change = change;
+	std::size_t total = 0;
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++) total += (r.len[f] = text[f].size());
+	r.overflow = 0;
+	char *dest = r.payload;
+	if (total > sizeof(r.payload)) {
+		r.overflow = spareString();
+		r.overflow->clear(); // Keeps the capacity
+		dest = 0;
+	}
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++) {
+		if (dest) {
+			memcpy(dest, text[f].data(), r.len[f]);
+			dest += r.len[f];
+		} else {
+			*r.overflow += text[f];
+		}
+	}
+	m_ring->publish(cell);
+	if (m_writerSleeping.load()) {
+		// publish() is sequentially consistent, so either the writer sees the record or we see it sleeping
+		boost::mutex::scoped_lock wake_lock(m_wakeMutex);
+		m_wake.notify_one();
+	}
+}
+
+Slog::SinkChange *
+Slog::takeSlot(SlogRing<PendingRecord>::Cell *cell, int &lvl, bool &framing, std::string text[SLOG_FORMAT_COUNT]) {
+	const PendingRecord &r = cell->data;
+	const char *src = r.overflow ? r.overflow->data() : r.payload;
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++) {
+		text[f].assign(src, r.len[f]);
+		src += r.len[f];
+	}
+	lvl = r.level;
+	framing = r.framing;
+	SinkChange *change = r.change;
+	recycle(r.overflow);
+	m_ring->release(cell); // Free the slot before the slow part
+	return change;
+}
+
+std::string *
+Slog::spareString(void) {
+	SlogRing<std::string*>::Cell *cell = m_pool->claimPop();
+	if (!cell) return new std::string;
+	std::string *str = cell->data;
+	m_pool->release(cell);
+	return str;
+}
+
+void
+Slog::recycle(std::string *str) {
+	if (!str) return;
+	SlogRing<std::string*>::Cell *cell = m_pool->claimPush();
+	if (!cell) {
+		delete str;
+		return;
+	}
+	cell->data = str;
+	m_pool->publish(cell);
+}
+#endif
+
+void
+Slog::writeRecord(const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT]) {
+	for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++) {
+		const std::string &t = text[(*sink)->getFormat()];
+		if (!t.empty() && (framing || lvl <= (*sink)->getLevel())) (*sink)->write(lvl, t);
+	}
+}
+
+void
+Slog::flushSinks(void) {
+	for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++)
+		(*sink)->flush();
+}
+
+void
+Slog::setFlushPolicy(const std::size_t bytes, const double seconds, const int level) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock st_lock(m_stateMutex); // For sinks
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+#endif
+	flushBytes = bytes;
+	flushSeconds = seconds;
+	flushLevel = level;
+	for (std::vector<SlogSink*>::const_iterator sink=sinks.begin(); sink!=sinks.end(); sink++)
+		(*sink)->setFlushPolicy(bytes, seconds, level);
+}
+
+void
+Slog::setRotation(const std::size_t bytes, const double seconds, const unsigned keep) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock st_lock(m_stateMutex); // For fileSink
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+#endif
+	rotateBytes = bytes;
+	rotateSeconds = seconds;
+	rotateKeep = keep;
+	if (fileSink) fileSink->setRotation(bytes, seconds, keep);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Crash handling
+//////////////////////////////////////////////////////////////////////
+
+#ifndef WIN32
+/// Most Slogs the crash handler looks after
+#define SLOG_CRASH_LOGS 16
+
+/// The Slogs the crash handler looks after.  Empty entries are null.
+#ifdef CONCURRENT_BOOST
+static boost::atomic<Slog*> crashLogs[SLOG_CRASH_LOGS];
+static boost::mutex crashLogsMutex; ///< Held while crashLogs is changed
+#else
+static Slog *volatile crashLogs[SLOG_CRASH_LOGS];
+#endif
+/// The signals that get handled
+static const int crashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+#define SLOG_CRASH_SIGNALS (sizeof(crashSignals)/sizeof(crashSignals[0]))
+static struct sigaction crashPrevious[SLOG_CRASH_SIGNALS]; ///< The handlers from before, to pass the signal on to
+static bool crashInstalled = false; ///< Has the handler been installed?
+static volatile sig_atomic_t crashing = 0; ///< Set once a signal has come in
+
+/// Flush every Slog, then hand the signal on
+static void crashHandler(const int sig) {
+	if (!crashing) { // A second signal while flushing goes straight on
+		crashing = 1;
+		for (int i=0; i<SLOG_CRASH_LOGS; i++) {
+			Slog *log = crashLogs[i];
+			if (log) log->crashFlush(sig);
+		}
+	}
+	// The signal is blocked until this returns, and then the old handler gets it.  A SIGSEGV
+	// that is not raised again just happens again when the faulting instruction reruns.
+	for (std::size_t i=0; i<SLOG_CRASH_SIGNALS; i++)
+		if (sig==crashSignals[i]) sigaction(sig, &crashPrevious[i], 0);
+	raise(sig);
+}
+
+/// Name of one of crashSignals
+static const char *crashSignalName(const int sig) {
+	switch (sig) {
+	case SIGSEGV: return "SIGSEGV";
+	case SIGBUS: return "SIGBUS";
+	case SIGFPE: return "SIGFPE";
+	case SIGILL: return "SIGILL";
+	case SIGABRT: return "SIGABRT";
+	}
+	return "unknown";
+}
+
+/// \brief Fixed size text for the crash handler to build records in.  Too much is cut off.
+///
+/// Static rather than on the stack, which may be a small alternate signal stack.  Only one
+/// thread gets to use it, thanks to crashing.
+class CrashText {
+public:
+	CrashText() : len(0) {}
+	void add(const char *str, const std::size_t n) {
+		const std::size_t room = sizeof(buf)-len;
+		memcpy(buf+len, str, n<room ? n : room);
+		len += n<room ? n : room;
+	}
+	void add(const char c) {add(&c, 1);}
+	void add(const char *str) {add(str, strlen(str));}
+	void add(const std::string &str) {add(str.data(), str.size());}
+	template <typename T>
+	void addRaw(const T v) {add(reinterpret_cast<const char *>(&v), sizeof(v));}
+	char buf[4096];
+	std::size_t len;
+};
+static CrashText crashMessage; ///< The entry's message
+static CrashText crashText; ///< The record for one sink
+#endif
+
+void
+Slog::enableCrashHandler(void) {
+#ifndef WIN32
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(crashLogsMutex);
+#endif
+	int free = -1;
+	for (int i=0; i<SLOG_CRASH_LOGS; i++) {
+		Slog *log = crashLogs[i];
+		if (this==log) return;
+		if (!log && 0>free) free = i;
+	}
+	if (0>free) {
+		cerr << "Slog: the crash handler can only look after " << SLOG_CRASH_LOGS << " logs" << endl;
+		return;
+	}
+	crashLogs[free] = this;
+	if (crashInstalled) return;
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = crashHandler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_ONSTACK; // Use the alternate stack if the program set one up
+	for (std::size_t i=0; i<SLOG_CRASH_SIGNALS; i++)
+		sigaction(crashSignals[i], &action, &crashPrevious[i]);
+	crashInstalled = true;
+#endif
+}
+
+void
+Slog::disableCrashHandler(void) {
+#ifndef WIN32
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(crashLogsMutex);
+#endif
+	for (int i=0; i<SLOG_CRASH_LOGS; i++) {
+		Slog *log = crashLogs[i];
+		if (this==log) crashLogs[i] = 0;
+	}
+#endif
+}
+
+void
+Slog::crashFlush(UNUSED const int sig) {
+#ifndef WIN32
+	// No locks are taken, so whatever the other threads were doing is read as it stands.  The
+	// sinks are the ones being written to, which the queued records were formatted for.
+#ifdef CONCURRENT_BOOST
+	m_crashed.store(true); // The writer thread stops after the record it is on
+#endif
+	for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++)
+		(*sink)->crashFlush();
+#ifdef CONCURRENT_BOOST
+	// Records the writer thread has not got to yet
+	for (std::size_t i=0; m_ring && i<m_ring->capacity(); i++) {
+		const SlogRing<PendingRecord>::Cell *cell = m_ring->peek(i);
+		if (!cell) break;
+		const PendingRecord &r = cell->data;
+		const char *text[SLOG_FORMAT_COUNT];
+		const char *src = r.overflow ? r.overflow->data() : r.payload;
+		for (int f=0; f<SLOG_FORMAT_COUNT; f++) {
+			text[f] = src;
+			src += r.len[f];
+		}
+		for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++) {
+			const SlogSinkFormat f = (*sink)->getFormat();
+			if (0<r.len[f] && (r.framing || r.level <= (*sink)->getLevel())) (*sink)->crashWrite(text[f], r.len[f]);
+		}
+	}
+#endif
+	// The signal, without a time stamp or location
+	char num[SLOG_NUMBER_BUFSIZE];
+	const std::size_t numLen = slogFormatSigned(num, sig);
+	crashMessage.len = 0;
+	crashMessage.add("fatal signal ");
+	crashMessage.add(num, numLen);
+	crashMessage.add(" (");
+	crashMessage.add(crashSignalName(sig));
+	crashMessage.add(')');
+	const char *message = crashMessage.buf;
+	const std::size_t messageLen = crashMessage.len;
+	const bool scoped = !stateStack.empty();
+	for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++) {
+		crashText.len = 0;
+		switch ((*sink)->getFormat()) {
+		case FORMAT_CONSOLE:
+			crashText.add(depthLabel);
+			crashText.add(indentPrefix);
+			if (scoped) crashText.add(curScope);
+			crashText.add(": ");
+			crashText.add(message, messageLen);
+			crashText.add("\n");
+			break;
+		case FORMAT_TEXT:
+			crashText.add(indentPrefix);
+			if (scoped) {
+				crashText.add(curScope);
+				crashText.add(": ");
+			}
+			crashText.add(message, messageLen);
+			crashText.add("\n");
+			break;
+		case FORMAT_XML:
+			crashText.add(indentPrefix);
+			crashText.add("<entry");
+			if (scoped) {
+				crashText.add(" scope=\"");
+				crashText.add(curScope);
+				crashText.add("\"");
+			}
+			crashText.add(">");
+			crashText.add(message, messageLen);
+			crashText.add("</entry>\n");
+			break;
+		case FORMAT_BINARY:
+			// The same as binaryEntry() with no time or location and one string argument
+			crashText.add(char(SLOG_BIN_ENTRY));
+			crashText.addRaw<unsigned>(4+8+4+1+4+messageLen);
+			crashText.addRaw<int>(ALWAYS);
+			crashText.addRaw<SlogLongLong>(LLONG_MIN);
+			crashText.addRaw<unsigned>(0);
+			crashText.add(char(SLOG_ARG_STRING));
+			crashText.addRaw<unsigned>(messageLen);
+			crashText.add(message, messageLen);
+			break;
+		}
+		(*sink)->crashWrite(crashText.buf, crashText.len);
+		// Close the scopes, innermost first, as popState() would
+		for (std::size_t depth=stateStack.size(); 0<depth && FORMAT_XML==(*sink)->getFormat(); depth--) {
+			crashText.len = 0;
+			crashText.add(indentPrefix.data(), (depth-1)*stateIndent.size());
+			crashText.add("</scope> <!-- ");
+			crashText.add(stateStack[depth-1]);
+			crashText.add(" -->\n");
+			(*sink)->crashWrite(crashText.buf, crashText.len);
+		}
+		for (std::size_t depth=stateStack.size(); 0<depth && FORMAT_BINARY==(*sink)->getFormat(); depth--) {
+			const char pop[SLOG_BIN_RECORD_HEAD] = {SLOG_BIN_POP, 0, 0, 0, 0};
+			(*sink)->crashWrite(pop, sizeof(pop));
+		}
+		(*sink)->crashClose();
+	}
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Live reconfiguration
+//////////////////////////////////////////////////////////////////////
+
+#ifndef WIN32
+static volatile sig_atomic_t hangups = 0; ///< SIGHUPs so far.  Only the handler writes it.
+static bool hangupInstalled = false; ///< Has the SIGHUP handler been installed?
+#ifdef CONCURRENT_BOOST
+static boost::mutex hangupMutex; ///< Held while the SIGHUP handler is installed
+#endif
+
+/// Count the signal for pollConfig() to find
+static void hangupHandler(int) {
+	hangups = hangups+1;
+}
+#endif
+
+/// How many SIGHUPs have come in
+static long hangupCount(void) {
+#ifndef WIN32
+	return hangups;
+#else
+	return 0;
+#endif
+}
+
+/// Modification time, size and inode of filename, or all -1 if it is not there
+static void configStampOf(const std::string &filename, SlogLongLong stamp[3]) {
+	struct stat st;
+	if (0!=stat(filename.c_str(), &st)) {
+		stamp[0] = stamp[1] = stamp[2] = -1;
+		return;
+	}
+	stamp[0] = st.st_mtime;
+	stamp[1] = st.st_size;
+	stamp[2] = st.st_ino;
+}
+
+/// str without the spaces and tabs at either end
+static std::string configTrim(const std::string &str) {
+	const std::string::size_type start = str.find_first_not_of(" \t\r");
+	if (std::string::npos==start) return std::string();
+	return str.substr(start, str.find_last_not_of(" \t\r")-start+1);
+}
+
+/// Read a level, as a number or a name.  @return false if it is neither
+static bool configLevel(const std::string &value, int &lvl) {
+	static const char *names[] = {"LACONIC", "TERSE", "TRACE", "VERBOSE", "BOMBASTIC"};
+	for (int i=0; i<int(sizeof(names)/sizeof(names[0])); i++)
+		if (value==names[i]) {lvl = LACONIC+i; return true;}
+	if (value.empty()) return false;
+	char *end;
+	const long n = strtol(value.c_str(), &end, 10);
+	if ('\0'!=*end || 0>n || NEVER<n) return false;
+	lvl = int(n);
+	return true;
+}
+
+/// Read an on or off flag.  @return false if it is not one
+static bool configFlag(const std::string &value, bool &flag) {
+	if ("on"==value || "yes"==value || "true"==value || "1"==value) {flag = true; return true;}
+	if ("off"==value || "no"==value || "false"==value || "0"==value) {flag = false; return true;}
+	return false;
+}
+
+bool
+Slog::loadConfig(const std::string &filename) {
+	if (rootLog) return rootLog->loadConfig(filename);
+	std::ifstream in(filename.c_str());
+	if (!in) {
+		entry(ALWAYS, "could not read config file " + filename);
+		return false;
+	}
+	// Check it all first, so that a bad or half written file changes nothing
+	std::vector<std::pair<std::string,std::string> > settings;
+	bool fileSet = false;
+	std::string fileName; // The last one counts
+	bool xmlSet = false;
+	bool xml = false;
+	std::string line;
+	for (int lineno=1; std::getline(in, line); lineno++) {
+		line = configTrim(line);
+		if (line.empty() || '#'==line[0]) continue;
+		const std::string::size_type equals = line.find('=');
+		const std::string key = configTrim(line.substr(0, equals));
+		const std::string value = std::string::npos!=equals ? configTrim(line.substr(equals+1)) : std::string();
+		int lvl = 0;
+		bool flag = false;
+		bool good;
+		if (std::string::npos==equals) good = false;
+		else if ("level"==key) good = configLevel(value, lvl);
+		else if (0==key.compare(0, 6, "level.")) good = 6<key.size() && ("inherit"==value || configLevel(value, lvl));
+		else if ("time"==key || "location"==key || "xml"==key || "collapse"==key) good = configFlag(value, flag);
+		else good = "file"==key;
+		if (!good) {
+			stringstream sstr;
+			sstr << filename << ":" << lineno << ": bad setting, nothing changed: " << line;
+			entry(ALWAYS, sstr.str());
+			return false;
+		}
+		settings.push_back(std::make_pair(key, value));
+		if ("file"==key) {
+			fileSet = true;
+			fileName = value;
+		}
+		if ("xml"==key) {
+			xmlSet = true;
+			xml = flag;
+		}
+	}
+
+	// Open the new file before taking the locks, in the format it will end up in
+	SlogFileSink *file = 0;
+	if (!fileName.empty()) {
+		if (!xmlSet) {
+#ifdef CONCURRENT_BOOST
+			boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+			xml = xmlEnabled;
+		}
+		file = openLogFile(fileName, true, xml);
+	}
+
+	// All in one change, so nothing is logged with only some of the settings
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+	beginChange();
+	SinkChange *change = newSinkChange();
+	std::vector<SlogSink*> dropped;
+	for (std::vector<std::pair<std::string,std::string> >::const_iterator s=settings.begin(); s!=settings.end(); s++) {
+		const std::string &key = s->first;
+		const std::string &value = s->second;
+		int lvl = 0;
+		bool flag = false;
+		if ("level"==key) {
+			configLevel(value, lvl);
+			setLevel(lvl);
+		} else if (0==key.compare(0, 6, "level.")) {
+			Slog &logger = getLogger(key.substr(6));
+			if ("inherit"==value) logger.inheritLevel();
+			else if (configLevel(value, lvl)) logger.setLevel(lvl);
+		} else if ("file"!=key) { // The file is open already
+			configFlag(value, flag);
+			if ("time"==key) flag ? enableTime() : disableTime();
+			else if ("location"==key) flag ? enableLocation() : disableLocation();
+			else if ("collapse"==key) setCollapse(flag);
+			else setXml(flag, *change);
+		}
+	}
+	// Last, so it is checked against the xml setting above
+	if (fileSet) swapLogFile(file, *change, dropped);
+	changeSinks(change);
+	publish();
+	dropSinks(dropped);
+#ifdef CONCURRENT_BOOST
+	st_lock.unlock();
+	op_lock.unlock();
+#endif
+	entry(ALWAYS, "loaded config file " + filename);
+	return true;
+}
+
+void
+Slog::watchConfig(const std::string &filename, UNUSED const double seconds) {
+	if (rootLog) {rootLog->watchConfig(filename, seconds); return;}
+#ifndef WIN32
+	{
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock lock(hangupMutex);
+#endif
+		if (!hangupInstalled) {
+			struct sigaction action;
+			memset(&action, 0, sizeof(action));
+			action.sa_handler = hangupHandler;
+			sigemptyset(&action.sa_mask);
+			action.sa_flags = SA_RESTART; // Reads and writes carry on through a SIGHUP
+			sigaction(SIGHUP, &action, 0);
+			hangupInstalled = true;
+		}
+	}
+#endif
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock watch_lock(m_watchMutex);
+	stopConfigWatcher(); // Start fresh
+	boost::mutex::scoped_lock lock(m_configMutex);
+#endif
+	configFile = filename;
+	configStampOf(configFile, configStamp);
+	configHangups = hangupCount();
+	loadConfig(configFile);
+#ifdef CONCURRENT_BOOST
+	lock.unlock();
+	if (0<seconds) {
+		m_configSeconds = seconds;
+		m_configStop = false;
+		m_configWatcher = new boost::thread(&Slog::configLoop, this);
+	}
+#endif
+}
+
+void
+Slog::unwatchConfig(void) {
+	if (rootLog) {rootLog->unwatchConfig(); return;}
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock watch_lock(m_watchMutex);
+	stopConfigWatcher();
+	boost::mutex::scoped_lock lock(m_configMutex);
+#endif
+	configFile.clear();
+}
+
+bool
+Slog::pollConfig(void) {
+	if (rootLog) return rootLog->pollConfig();
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock lock(m_configMutex);
+#endif
+	if (configFile.empty()) return false;
+	SlogLongLong stamp[3];
+	configStampOf(configFile, stamp);
+	const long hangupsNow = hangupCount();
+	if (hangupsNow==configHangups && std::equal(stamp, stamp+3, configStamp)) return false;
+	configHangups = hangupsNow;
+	std::copy(stamp, stamp+3, configStamp);
+	loadConfig(configFile);
+	return true;
+}
+
+#ifdef CONCURRENT_BOOST
+void
+Slog::configLoop(void) {
+	const long millis = static_cast<long>(m_configSeconds*1000);
+	const boost::posix_time::milliseconds interval(0<millis ? millis : 1);
+	boost::mutex::scoped_lock lock(m_configMutex);
+	while (!m_configStop) {
+		m_configWake.timed_wait(lock, interval);
+		if (m_configStop) break;
+		lock.unlock();
+		pollConfig();
+		lock.lock();
+	}
+}
+
+void
+Slog::stopConfigWatcher(void) {
+	if (!m_configWatcher) return;
+	{
+		boost::mutex::scoped_lock lock(m_configMutex);
+		m_configStop = true;
+		m_configWake.notify_all();
+	}
+	m_configWatcher->join();
+	delete m_configWatcher;
+	m_configWatcher = 0;
+}
+#endif
+
+void
+Slog::enableAsync(const std::size_t size, const SlogOverflowPolicy policy) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+	beginChange();
+	stopWriter(); // Start fresh if the ring settings are changing
+	{
+		// Anybody writing directly got in before the change, and is finished once this is ours
+		boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+	}
+	queueSize = (0<size ? size : 1);
+	overflowPolicy = policy;
+	m_ring = new SlogRing<PendingRecord>(queueSize);
+	m_pool = new SlogRing<std::string*>(queueSize);
+	m_writerStop.store(false);
+	m_writer = new boost::thread(&Slog::writerLoop, this);
+	m_asyncEnabled.store(true);
+	publish();
+#else
+	// Nothing to run a writer thread with, so stay synchronous
+	queueSize = size;
+	overflowPolicy = policy;
+#endif
+}
+
+void
+Slog::disableAsync(void) {
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock op_lock(m_outputMutex);
+	boost::mutex::scoped_lock st_lock(m_stateMutex);
+	beginChange(); // Direct writes wait for the queue to be written out first
+	stopWriter();
+	publish();
+#endif
+}
+
+#ifdef CONCURRENT_BOOST
+void
+Slog::stopWriter(void) {
+	if (!m_writer) return;
+	synchronize(); // Anybody part way through queueing a record has finished
+	m_asyncEnabled.store(false);
+	m_writerStop.store(true);
+	{
+		boost::mutex::scoped_lock wake_lock(m_wakeMutex);
+		m_wake.notify_all();
+	}
+	m_writer->join(); // The writer empties the ring before it quits
+	delete m_writer;
+	m_writer = 0;
+	SlogRing<std::string*>::Cell *cell;
+	while ((cell = m_pool->claimPop())) {
+		delete cell->data;
+		m_pool->release(cell);
+	}
+	delete m_ring;
+	delete m_pool;
+	m_ring = 0;
+	m_pool = 0;
+}
+#endif
+
+bool
+Slog::getAsyncStatus(void) {
+#ifdef CONCURRENT_BOOST
+	return m_asyncEnabled.load();
+#else
+	return false;
+#endif
+}
+
+unsigned long
+Slog::getDroppedCount(void) {
+#ifdef CONCURRENT_BOOST
+	return m_dropped.load();
+#else
+	return 0;
+#endif
+}
+
+void
+Slog::flush(void) {
+	if (rootLog) {rootLog->flush(); return;}
+	{
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock op_lock(m_outputMutex);
+#endif
+		flushRepeats(); // Repeats being held are output that has not come out yet
 	}
-	std::string *rtn = new std::string(os.str());
-	return *rtn;
+#ifdef CONCURRENT_BOOST
+	drainQueue();
+	boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+#endif
+	flushSinks();
 }
 
-/// Allow the definition of time to be tweaked.  Floats should be enough for now
-#define TIME_T float //double
-//#define TIME_T int
-
-bool
-Slog::entry(const int lvl, const std::string str) {
 #ifdef CONCURRENT_BOOST
-	boost::mutex::scoped_lock	lock(m_outputMutex);
+void
+Slog::drainQueue(void) {
+	// Everything queued so far has to come out the other end.  The writer always
+	// empties the ring before it stops, so this cannot wait forever.
+	const unsigned long target = m_queued.load();
+	boost::mutex::scoped_lock wake_lock(m_wakeMutex);
+	while (m_written.load() < target) m_queueDrained.wait(wake_lock);
+}
 #endif
-	if (lvl>logLevel) return false; // Not powerful enough to get out
+
 #ifdef CONCURRENT_BOOST
-	boost::posix_time::ptime now(boost::posix_time::second_clock::universal_time());
-	std::stringstream ss;
-	ss << now;
-	std::string currentSysTime = ss.str();
-#else
-#ifdef WIN32
-    timeb timebuffer;
-    ftime(&timebuffer);
-    const TIME_T currentSysTime = timebuffer.time+(timebuffer.millitm/1000.0);
-#else
-    timeval timebuffer;
-    gettimeofday(&timebuffer,NULL);
-    const TIME_T currentSysTime = timebuffer.tv_sec+(timebuffer.tv_usec/1000000.0);
-#endif
-#endif
-	if (timeEnabled)
-		cerr << currentSysTime << ": ";
-	cerr << getStateNumberStr() << indent() << getCurScope() << ": ";
-	if (locationEnabled && curLocation != Where())
-		cerr << format_location(false) << ": ";
-	cerr << str << endl;
-	if (logFile.is_open()) {
-		if (xmlEnabled) {
-			logFile << indent() << "<entry";
-			//logFile.setf(ios_base::fixed,ios::floatfield);
-			if (timeEnabled)
-				logFile << " time=\""<< currentSysTime << "\"";
-			if (!stateStack.empty()) {
-				logFile << " scope=\"" << stateStack[stateStack.size()-1] << "\"";
+void
+Slog::writerLoop(void) {
+	std::string text[SLOG_FORMAT_COUNT];
+	bool pending = false; // Is a sink holding output back?
+	bool idle = false; // Did a whole flush interval go by without any records?
+	for (;;) {
+		unsigned long written = 0;
+		{
+			// The flush policy decides when records actually reach the files
+			boost::mutex::scoped_lock sink_lock(m_sinkMutex);
+			SlogRing<PendingRecord>::Cell *cell;
+			while (written < m_ring->capacity() && !m_crashed.load() && (cell = m_ring->claimPop())) {
+				int lvl;
+				bool framing;
+				if (SinkChange *change = takeSlot(cell, lvl, framing, text)) applySinkChange(change);
+				else writeRecord(lvl, framing, text);
+				written++;
 			}
-			logFile << ">";
-			if (locationEnabled && curLocation != Where())
-				logFile << format_location(true);
-			logFile << str << "</entry>" << endl;;
-		} else {
-			// NO XML
-			logFile << indent();
-			if (timeEnabled)
-				logFile << currentSysTime << " ";
-			if (locationEnabled && curLocation != Where())
-				logFile << format_location(false) << ": ";
-			if (!stateStack.empty()) logFile << stateStack[stateStack.size()-1] << ": ";
-			logFile << str << endl;
+			if (idle && !m_crashed.load()) flushSinks();
+			pending = false;
+			for (std::vector<SlogSink*>::const_iterator sink=writing.begin(); sink!=writing.end(); sink++)
+				pending = pending || (*sink)->pending();
+		}
+		idle = false;
+		if (written) {
+			m_written.fetch_add(written);
+			{
+				boost::mutex::scoped_lock wake_lock(m_wakeMutex);
+			}
+			m_queueDrained.notify_all();
+			continue; // More may have come in while we were writing
 		}
+		if (m_writerStop.load()) {
+			// stopWriter() made sure nobody is part way through queueing a record
+			if (m_ring->empty()) return;
+			boost::this_thread::yield();
+			continue;
+		}
+		boost::mutex::scoped_lock wake_lock(m_wakeMutex);
+		m_writerSleeping.store(true);
+		if (m_ring->empty() && !m_writerStop.load()) {
+			if (pending && 0 < flushSeconds) {
+				// Do not leave output sitting in a buffer just because things went quiet
+				const boost::posix_time::milliseconds interval(static_cast<long>(flushSeconds*1000));
+				idle = !m_wake.timed_wait(wake_lock, interval);
+			} else {
+				m_wake.wait(wake_lock);
+			}
+		}
+		m_writerSleeping.store(false);
 	}
+}
+#endif
+
+bool
+Slog::partial(const int lvl, const std::string &str) {
+	if (!isEnabled(lvl)) return false; // Not powerful enough to get out
+	Accumulator &acc = accumulator(); // Only this thread can see its accumulator, so no locking
+	startMessage(acc,lvl);
+	SlogBuffer(acc.str,acc.binary).append(str);
 	return true;
 }
 
 bool
-Slog::partial(const int lvl, const std::string str) {
-#ifdef CONCURRENT_BOOST
-	// TODO: Could this be done with lock.has_lock()?
-	bool need_acc_lock = false;
-	m_stateMutex.lock();
-	if (boost::this_thread::get_id() != m_currentThread) need_acc_lock = true;
-	m_stateMutex.unlock();
-	if (need_acc_lock) {
-		m_accumulatorMutex.lock();
-		m_currentThread = boost::this_thread::get_id();
-	}
-#endif
-	if (lvl>logLevel) return false; // Not powerful enough to get out
-	curStr += str;
+Slog::partial(const int lvl, const char *str, const std::size_t len) {
+	if (!isEnabled(lvl)) return false; // Not powerful enough to get out
+	Accumulator &acc = accumulator();
+	startMessage(acc,lvl);
+	SlogBuffer(acc.str,acc.binary).append(str,len);
 	return true;
 }
 
-// TODO: Could we add a timeout watchdog here to stop a single thread from locking m_accumulatorMutex
-// forever?
 bool
 Slog::complete(void)
 {
-	bool rc = false;
-#ifdef CONCURRENT_BOOST
-	boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-	if (0==curStr.length()) {
-		rc = false; // Nothing to log, so ignore the request
-	} else {
-		entry(ALWAYS, curStr); // We got this far so for a message to go out.
-		curStr="";
-		curLocation = Where();
-		rc = true;
-	}
-#ifdef CONCURRENT_BOOST
-	m_currentThread = boost::thread::id();	// i.e., Not-a-Thread
-	m_accumulatorMutex.unlock();
-#endif
-	return rc;
+	Accumulator &acc = accumulator();
+	if (acc.str.empty()) return false; // Nothing to log, so ignore the request
+	output(acc.level, acc.str, acc.binary, acc.location); // We got this far so for a message to go out.
+	acc.str.clear(); // Keeps the capacity for the next message
+	acc.location = 0;
+	return true;
 }
 
 ////////////////////////////////////////
 // State
 
-std::string 
-Slog::indent() {
-	std::string s;
-	const int depth=getStateDepth();
-	for (int i=0;i<depth;i++) s+=stateIndent;
-	return s;
+void
+Slog::setStateIndent(const std::string &str) {
+	if (rootLog) {rootLog->setStateIndent(str); return;}
+#ifdef CONCURRENT_BOOST
+	boost::mutex::scoped_lock	op_lock(m_outputMutex);
+	boost::mutex::scoped_lock	st_lock(m_stateMutex);
+#endif
+	beginChange();
+	stateIndent=str;
+	indentPrefix.clear();
+	for (std::size_t i=0;i<stateStack.size();i++) indentPrefix+=stateIndent;
+	publish();
 }
 
-std::string 
-Slog::getStateNumberStr() {
-	stringstream sstr;
-	sstr << getStateDepth();
-	std::string s = sstr.str();
-	if (1==s.size()) s = " "+s;
-	return s;
+void
+Slog::updateScopeCache() {
+	slogDepthLabel(stateStack.size(), depthLabel);
+	if (stateStack.empty()) curScope.clear();
+	else curScope = stateStack.back();
 }
 
 // FIX: implement with xml goodness... now it just does scopes in straight text.
 void
 Slog::writeState(bool flat) {
+	if (rootLog) {rootLog->writeState(flat); return;}
 #ifdef CONCURRENT_BOOST
 	boost::mutex::scoped_lock op_lock(m_outputMutex);
 	boost::mutex::scoped_lock st_lock(m_stateMutex);
 #endif
+	flushRepeats();
+	std::string out;
 	if (flat) {
 		std::vector<std::string>::iterator itor;
 		for(itor = stateStack.begin(); itor!=stateStack.end(); itor++) {
-			cerr << "." << *itor;
-			if (logFile.is_open()) logFile << "." << *itor;
+			out += ".";
+			out += *itor;
 		}	
-		cerr << endl;
-		if (logFile.is_open()) logFile << endl;
+		out += "\n";
 	} else {
 		// Not flat
 		const int depth = stateStack.size();
 		for (int i=0; i<depth; i++) {
-			for (int z=0;z<i;z++) {
-				cerr << stateIndent;
-				if (logFile.is_open()) logFile << stateIndent;
-			}
-			cerr << stateStack[i] << endl;
-			if (logFile.is_open()) logFile << stateStack[i] << endl;
+			for (int z=0;z<i;z++) out += stateIndent;
+			out += stateStack[i];
+			out += "\n";
 		}	
 		//cerr << endl;
 		
 	}
+	std::string text[SLOG_FORMAT_COUNT];
+	for (int f=0; f<SLOG_FORMAT_COUNT; f++) text[f] = out; // The same in every text format
+	text[FORMAT_BINARY].clear();
+	binaryRecord(text[FORMAT_BINARY], SLOG_BIN_TEXT, out.size());
+	text[FORMAT_BINARY] += out;
+	write(ALWAYS, false, text); // Asked for explicitly, so make sure it shows up
 }
 
 void 
 Slog::pushState(std::string scope, int msgLvl) {
+	if (rootLog) {
+		// The scopes are shared, but the message level is this logger's own
+		rootLog->pushState(scope);
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+		pushMsgLevel(msgLvl);
+		return;
+	}
 #ifdef CONCURRENT_BOOST
 	boost::mutex::scoped_lock	op_lock(m_outputMutex);
 	boost::mutex::scoped_lock	st_lock(m_stateMutex);
 #endif
-	if (xmlEnabled) logFile << indent() << "<scope name=\""<< scope <<"\">" << endl;
+	beginChange(); // Entries still being formatted outside the scope have to go out before it opens
+	flushRepeats(); // The count belongs in the scope the repeats were in
+	const bool xml = haveSink(FORMAT_XML);
+	if (xml || binaryArgs) {
+		std::string text[SLOG_FORMAT_COUNT];
+		if (xml) slogFormatScopeStart(indentPrefix, scope, text[FORMAT_XML]);
+		if (binaryArgs) binaryPush(scope, text[FORMAT_BINARY]);
+		write(NEVER, true, text); // Framing alone never forces a flush
+	}
 	stateStack.push_back(scope);
+	indentPrefix += stateIndent;
+	updateScopeCache();
+	publish();
+	pushMsgLevel(msgLvl);
+}
+
+void
+Slog::pushMsgLevel(const int msgLvl) {
 	if (msgLvl != -1)
 	{
-		msgLvlStack.push_back(getMsgLevel());
+		msgLvlStack.push_back(msgLevel);
 		setMsgLevel(msgLvl);
 	}
 	else
@@ -334,25 +2379,489 @@ Slog::pushState(std::string scope, int msgLvl) {
 	}
 }
 
+void
+Slog::popMsgLevel(void) {
+	if (msgLvlStack.empty()) return; // The scope was pushed through another logger
+	const int ml = msgLvlStack.back();
+	if (ml != -1)
+		setMsgLevel(ml);
+	msgLvlStack.pop_back();
+}
+
 std::string
 Slog::popState() {
+	if (rootLog) {
+		const std::string s = rootLog->popState();
+#ifdef CONCURRENT_BOOST
+		boost::mutex::scoped_lock st_lock(m_stateMutex);
+#endif
+		popMsgLevel();
+		return s;
+	}
 #ifdef CONCURRENT_BOOST
 	boost::mutex::scoped_lock	op_lock(m_outputMutex);
 	boost::mutex::scoped_lock	st_lock(m_stateMutex);
 #endif
 	assert(!stateStack.empty()); // FIX: is it right to fail?
+	beginChange();
+	flushRepeats(); // The count belongs in the scope the repeats were in
 	std::string s=stateStack[stateStack.size()-1];
-	int ml = msgLvlStack[msgLvlStack.size()-1];
-	if (ml != -1)
-		setMsgLevel(ml);
+	popMsgLevel();
 	stateStack.pop_back();
-	msgLvlStack.pop_back();
-	if (xmlEnabled) logFile << indent() << "</scope> <!-- "<< s <<" -->" << endl;
+	indentPrefix.resize(indentPrefix.size()-stateIndent.size());
+	updateScopeCache();
+	const bool xml = haveSink(FORMAT_XML);
+	if (xml || binaryArgs) {
+		std::string text[SLOG_FORMAT_COUNT];
+		if (xml) slogFormatScopeEnd(indentPrefix, s, text[FORMAT_XML]);
+		if (binaryArgs) binaryRecord(text[FORMAT_BINARY], SLOG_BIN_POP, 0);
+		write(NEVER, true, text);
+	}
+	publish();
 	return s;
 }
 
+////////////////////////////////////////
+// Snapshots
+
+const Slog::Snapshot &
+Slog::enter(unsigned long &epoch) {
+#ifdef CONCURRENT_BOOST
+	for (;;) {
+		epoch = m_epoch.load();
+		m_readers[epoch&1].fetch_add(1);
+		if (epoch==m_epoch.load()) { // Counted before the epoch moved on, so advanceEpoch() saw it
+			const unsigned long gen = m_gen.load();
+			const Snapshot *snap = m_snapshot.load();
+			if (gen==snap->gen) return *snap; // Never odd
+		}
+		m_readers[epoch&1].fetch_sub(1);
+		boost::this_thread::yield(); // Let the change get published
+	}
+#else
+	epoch = 0;
+	return *m_snapshot;
+#endif
+}
+
+void
+Slog::leave(UNUSED const unsigned long epoch) {
+#ifdef CONCURRENT_BOOST
+	m_readers[epoch&1].fetch_sub(1);
+#endif
+}
+
+const Slog::Snapshot &
+Slog::current(void) const {
+#ifdef CONCURRENT_BOOST
+	return *m_snapshot.load();
+#else
+	return *m_snapshot;
+#endif
+}
+
+void
+Slog::beginChange(void) {
+#ifdef CONCURRENT_BOOST
+	m_gen.store(m_gen.load()+1);
+#else
+	m_gen++;
+#endif
+}
+
+void
+Slog::publish(void) {
+	Snapshot *snap = new Snapshot;
+#ifdef CONCURRENT_BOOST
+	snap->gen = m_gen.load()+1;
+#else
+	snap->gen = m_gen+1;
+#endif
+	assert(0==snap->gen%2); // beginChange() came first
+	snap->depthLabel = depthLabel;
+	snap->indent = indentPrefix;
+	snap->scoped = !stateStack.empty();
+	snap->scope = curScope;
+	snap->depth = stateStack.size();
+	snap->sinks = sinks;
+	for (std::size_t i=0; i<sinks.size(); i++) snap->formats.push_back(sinkFormat(sinks[i]));
+#ifdef CONCURRENT_BOOST
+	snap->async = m_asyncEnabled.load();
+#else
+	snap->async = false;
+#endif
+	snap->collapse = collapseEnabled;
+	snap->timeFormat = timeFormat;
+	snap->clockSource = clockSource;
+	snap->clockOffset = clockOffset;
+#ifdef CONCURRENT_BOOST
+	// The pointer first, so a thread that sees the new m_gen also sees the snapshot that goes with it
+	const Snapshot *old = m_snapshot.exchange(snap);
+	m_gen.store(snap->gen);
+	if (old) m_retired.push_back(std::make_pair(old, m_epoch.load()));
+	// Threads that could have old ones came in no later than their epoch, and are all gone
+	// once it has moved on twice
+	advanceEpoch();
+	advanceEpoch();
+	const unsigned long epoch = m_epoch.load();
+	std::size_t kept = 0;
+	for (std::size_t i=0; i<m_retired.size(); i++) {
+		if (m_retired[i].second+2 <= epoch) delete m_retired[i].first;
+		else m_retired[kept++] = m_retired[i];
+	}
+	m_retired.resize(kept);
+#else
+	delete m_snapshot;
+	m_snapshot = snap;
+	m_gen = snap->gen;
+#endif
+}
+
+#ifdef CONCURRENT_BOOST
+bool
+Slog::advanceEpoch(void) {
+	unsigned long epoch = m_epoch.load();
+	if (0!=m_readers[(epoch+1)&1].load()) return false; // Somebody from the epoch before is still reading
+	m_epoch.compare_exchange_strong(epoch, epoch+1); // Or somebody else moved it on
+	return true;
+}
+
+void
+Slog::synchronize(void) {
+	const unsigned long done = m_epoch.load()+2;
+	while (m_epoch.load() < done)
+		if (!advanceEpoch()) boost::this_thread::yield();
+}
+#endif
+
+
+
+
+//////////////////////////////////////////////////////////////////////
+// Record formatting, shared by Slog and SlogDecoder
+//////////////////////////////////////////////////////////////////////
+
+void
+slogFormatLocation(std::string &out, const Where &location, const bool xml)
+{
+	// WHERE hands us the leaf name of the file already, worked out once by the compiler, so
+	// this is nothing but appending
+	char line[SLOG_NUMBER_BUFSIZE];
+	const std::size_t lineLen = slogFormatSigned(line, location.getLineno());
+	if (xml) {
+		out += "<where file=\"";
+		out += location.getFile();
+		out += "\" line=\"";
+		out.append(line, lineLen);
+		out += "\" function=\"";
+		out += location.getFunction();
+		out += "\"/>";
+	} else {
+		out += '(';
+		out += location.getFile();
+		out += ':';
+		out.append(line, lineLen);
+		out += ':';
+		out += location.getFunction();
+		out += ')';
+	}
+}
+
+void
+slogFormatEntry(const SlogSinkFormat format, const SlogEntry &entry, std::string &out) {
+	// Everything is appended straight onto the record
+	switch (format) {
+	case FORMAT_CONSOLE:
+		if (entry.timeLen) {
+			out.append(entry.time,entry.timeLen);
+			out += ": ";
+		}
+		out += *entry.depthLabel;
+		out += *entry.indent;
+		if (entry.scope) out += *entry.scope;
+		out += ": ";
+		if (entry.location) {
+			slogFormatLocation(out,*entry.location,false);
+			out += ": ";
+		}
+		out += *entry.message;
+		out += '\n';
+		break;
+	case FORMAT_XML:
+		out += *entry.indent;
+		out += "<entry";
+		if (entry.timeLen) {
+			out += " time=\"";
+			out.append(entry.time,entry.timeLen);
+			out += '"';
+		}
+		if (entry.scope) {
+			out += " scope=\"";
+			out += *entry.scope;
+			out += '"';
+		}
+		out += '>';
+		if (entry.location)
+			slogFormatLocation(out,*entry.location,true);
+		out += *entry.message;
+		out += "</entry>\n";
+		break;
+	case FORMAT_TEXT:
+		out += *entry.indent;
+		if (entry.timeLen) {
+			out.append(entry.time,entry.timeLen);
+			out += ' ';
+		}
+		if (entry.location) {
+			slogFormatLocation(out,*entry.location,false);
+			out += ": ";
+		}
+		if (entry.scope) {
+			out += *entry.scope;
+			out += ": ";
+		}
+		out += *entry.message;
+		out += '\n';
+		break;
+	case FORMAT_BINARY:
+		assert(false); // Not text
+		break;
+	}
+}
+
+void
+slogDepthLabel(const std::size_t depth, std::string &out) {
+	char num[SLOG_NUMBER_BUFSIZE];
+	const std::size_t len = slogFormatUnsigned(num, depth);
+	out.assign(1==len ? 1 : 0, ' ');
+	out.append(num,len);
+}
+
+void
+slogFormatScopeStart(const std::string &indent, const std::string &name, std::string &out) {
+	out += indent;
+	out += "<scope name=\"";
+	out += name;
+	out += "\">\n";
+}
+
+void
+slogFormatScopeEnd(const std::string &indent, const std::string &name, std::string &out) {
+	out += indent;
+	out += "</scope> <!-- ";
+	out += name;
+	out += " -->\n";
+}
+
+bool
+slogDecodeArgs(const char *args, const std::size_t len, std::string &out) {
+	// The same SlogBuffer calls that would have made the text in the first place
+	SlogBuffer buf(out);
+	const char *p = args;
+	const char *end = args+len;
+	while (p<end) {
+		switch (*p++) {
+		case SLOG_ARG_SIGNED: {
+			SlogLongLong v;
+			if (!binaryRead(p,end,v)) return false;
+			buf.appendSigned(v);
+			break;
+		}
+		case SLOG_ARG_UNSIGNED: {
+			SlogULongLong v;
+			if (!binaryRead(p,end,v)) return false;
+			buf.appendUnsigned(v);
+			break;
+		}
+		case SLOG_ARG_DOUBLE: {
+			double v;
+			if (!binaryRead(p,end,v)) return false;
+			buf.appendDouble(v);
+			break;
+		}
+		case SLOG_ARG_FLOAT: {
+			float v;
+			if (!binaryRead(p,end,v)) return false;
+			buf.appendFloat(v);
+			break;
+		}
+		case SLOG_ARG_STRING: {
+			unsigned n;
+			if (!binaryRead(p,end,n) || std::size_t(end-p) < n) return false;
+			buf.append(p,n);
+			p += n;
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SlogDecoder
+//////////////////////////////////////////////////////////////////////
+
+/// Longest record payload the decoder believes.  Anything longer is damage.
+#define SLOG_BIN_MAX_PAYLOAD (1U<<30)
+
+/// Payload length from the start of a record
+static std::size_t payloadLength(const char *record) {
+	unsigned len;
+	memcpy(&len, record+1, sizeof(len));
+	return len;
+}
+
+SlogDecoder::SlogDecoder(const SlogSinkFormat format, const SlogTimeFormat timeFormat, const std::string &indentStr)
+: format(format), timeFormat(timeFormat), stateIndent(indentStr), started(false), depthLabel(" 0")
+{
+	assert(FORMAT_BINARY!=format);
+}
+
+bool
+SlogDecoder::decode(const char *data, const std::size_t len, std::string &out) {
+	const char *p = data;
+	const char *end = data+len;
+	// Finish off a record that started in an earlier piece
+	while (!pending.empty() && '\0'==pending[0]) pending.erase(0,1); // Padding, as below
+	while (!pending.empty()) {
+		std::size_t need = SLOG_BIN_RECORD_HEAD;
+		if (pending.size()>=need) {
+			if (SLOG_BIN_MAX_PAYLOAD < payloadLength(pending.data())) return false;
+			need += payloadLength(pending.data());
+		}
+		if (pending.size()==need) {
+			if (!record(pending[0], pending.data()+SLOG_BIN_RECORD_HEAD, need-SLOG_BIN_RECORD_HEAD, out)) return false;
+			pending.clear();
+			break;
+		}
+		if (p==end) return true; // Still not all here
+		const std::size_t take = std::min(need-pending.size(), std::size_t(end-p));
+		pending.append(p,take);
+		p += take;
+	}
+	// Then whole records straight out of data
+	while (std::size_t(end-p) >= SLOG_BIN_RECORD_HEAD) {
+		if ('\0'==*p) {
+			// No record type is a nul, so this is the unused end of a SlogMmapSink chunk
+			p++;
+			continue;
+		}
+		const std::size_t payload = payloadLength(p);
+		if (SLOG_BIN_MAX_PAYLOAD < payload) return false;
+		if (std::size_t(end-p) < SLOG_BIN_RECORD_HEAD+payload) break;
+		if (!record(*p, p+SLOG_BIN_RECORD_HEAD, payload, out)) return false;
+		p += SLOG_BIN_RECORD_HEAD+payload;
+	}
+	pending.assign(p, end-p);
+	return true;
+}
 
+void
+SlogDecoder::finish(std::string &out) {
+	if (FORMAT_XML==format) {
+		// A log that stopped without closing up, such as after a crash
+		while (!stack.empty()) {
+			indent.resize(indent.size()-stateIndent.size());
+			slogFormatScopeEnd(indent, stack.back(), out);
+			stack.pop_back();
+		}
+		if (started) out += "</slogcxx>\n";
+	}
+	started = false;
+	stack.clear();
+	indent.clear();
+	slogDepthLabel(0, depthLabel);
+}
 
+bool
+SlogDecoder::record(const char type, const char *payload, const std::size_t len, std::string &out) {
+	const char *p = payload;
+	const char *end = payload+len;
+	switch (type) {
+	case SLOG_BIN_HEADER: {
+		unsigned order, version;
+		if (len<8 || memcmp(p, "slogcxx", 8)) return false;
+		p += 8;
+		if (!binaryRead(p,end,order) || 0x01020304!=order) return false; // Other byte order
+		if (!binaryRead(p,end,version) || SLOG_BINARY_VERSION<version) return false;
+		// A new logger, maybe appending to an old file
+		finish(out);
+		sites.clear();
+		scopes.clear();
+		if (FORMAT_XML==format) out += "<slogcxx>\n";
+		started = true;
+		break;
+	}
+	case SLOG_BIN_LOCATION: {
+		unsigned id;
+		Site site;
+		if (!binaryRead(p,end,id) || !binaryRead(p,end,site.lineno)
+			|| !binaryReadString(p,end,site.file) || !binaryReadString(p,end,site.function))
+			return false;
+		sites[id] = site;
+		break;
+	}
+	case SLOG_BIN_SCOPE: {
+		unsigned id;
+		std::string name;
+		if (!binaryRead(p,end,id) || !binaryReadString(p,end,name)) return false;
+		scopes[id] = name;
+		break;
+	}
+	case SLOG_BIN_PUSH: {
+		unsigned id;
+		if (!binaryRead(p,end,id)) return false;
+		const std::string &name = scopes[id];
+		if (FORMAT_XML==format) slogFormatScopeStart(indent, name, out);
+		stack.push_back(name);
+		indent += stateIndent;
+		slogDepthLabel(stack.size(), depthLabel);
+		break;
+	}
+	case SLOG_BIN_POP:
+		if (stack.empty()) return false;
+		indent.resize(indent.size()-stateIndent.size());
+		slogDepthLabel(stack.size()-1, depthLabel);
+		if (FORMAT_XML==format) slogFormatScopeEnd(indent, stack.back(), out);
+		stack.pop_back();
+		break;
+	case SLOG_BIN_ENTRY: {
+		int level;
+		SlogLongLong micros;
+		unsigned id;
+		std::string message;
+		if (!binaryRead(p,end,level) || !binaryRead(p,end,micros) || !binaryRead(p,end,id)
+			|| !slogDecodeArgs(p, end-p, message))
+			return false;
+		char time[SLOG_TIME_BUFSIZE];
+		SlogEntry entry;
+		entry.timeLen = LLONG_MIN==micros ? 0 : slogFormatTime(time, micros, timeFormat);
+		entry.time = time;
+		entry.location = 0;
+		entry.message = &message;
+		entry.depthLabel = &depthLabel;
+		entry.indent = &indent;
+		entry.scope = stack.empty() ? 0 : &stack.back();
+		const std::map<unsigned,Site>::const_iterator site = sites.find(id);
+		if (sites.end()==site) {
+			slogFormatEntry(format, entry, out); // No location, or its definition went missing
+			break;
+		}
+		const Where where(site->second.file.c_str(), site->second.lineno, site->second.function.c_str());
+		entry.location = &where;
+		slogFormatEntry(format, entry, out);
+		break;
+	}
+	case SLOG_BIN_TEXT:
+		out.append(p, len);
+		break;
+	default:
+		break; // From a newer version.  Skip it.
+	}
+	return true;
+}
 
 //////////////////////////////////////////////////////////////////////
 // IO Manipulators that control the ``stream''
@@ -390,104 +2899,175 @@ Slog& decl(Slog& s) {
 // Handlers for each type that can be logged.
 //////////////////////////////////////////////////////////////////////
 
-// stringstream is probably not the fastest way to do this
-// FIX: This should be templated!!  Or can I if there are lots of special cases?
+// Numbers are logged by the operator<< template in the header, which formats into the message
+// with the functions here.  A stringstream used to be built for each value, and that was the
+// most expensive part of a log line.
 
-Slog& operator<< (Slog &s, const int &r) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << r;
-	s.partial(lvl,sstr.str());
-	return s;
-}
+/// Pairs of digits so that integers get converted two digits at a time
+static const char digitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
 
-Slog& operator<< (Slog &s, const unsigned int &r) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << r;
-	s.partial(lvl,sstr.str());
-	return s;
+std::size_t
+slogFormatUnsigned(char *buf, SlogULongLong v) {
+	char tmp[SLOG_NUMBER_BUFSIZE];
+	char *p = tmp + sizeof(tmp); // Fill in from the least significant end
+	while (v >= 100) {
+		const unsigned idx = static_cast<unsigned>(v % 100) * 2;
+		v /= 100;
+		*--p = digitPairs[idx+1];
+		*--p = digitPairs[idx];
+	}
+	if (v >= 10) {
+		const unsigned idx = static_cast<unsigned>(v) * 2;
+		*--p = digitPairs[idx+1];
+		*--p = digitPairs[idx];
+	} else {
+		*--p = static_cast<char>('0' + v);
+	}
+	const std::size_t len = tmp + sizeof(tmp) - p;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+	return len;
 }
 
-Slog& operator<< (Slog &s, const size_t &r) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << r;
-	s.partial(lvl,sstr.str());
-	return s;
+std::size_t
+slogFormatSigned(char *buf, const SlogLongLong v) {
+	if (v >= 0) return slogFormatUnsigned(buf, v);
+	buf[0] = '-';
+	// Negate as unsigned so that LLONG_MIN works too
+	return 1 + slogFormatUnsigned(buf+1, SlogULongLong(0) - static_cast<SlogULongLong>(v));
 }
 
+// With a C++17 library, std::to_chars already produces the shortest text that reads back as
+// the same value, and does it much faster than snprintf.  Otherwise, go through snprintf with
+// more and more digits until the value survives the round trip.
 
-Slog& operator<< (Slog &s, const char &c) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << c;
-	s.partial(lvl,sstr.str());
-	return s;
+std::size_t
+slogFormatDouble(char *buf, const double v) {
+#ifdef __cpp_lib_to_chars
+	const std::to_chars_result r = std::to_chars(buf, buf+SLOG_NUMBER_BUFSIZE-1, v);
+	*r.ptr = '\0';
+	return r.ptr - buf;
+#else
+	// Anything that has a 15 digit or shorter representation comes out right the first time.
+	// %g drops the trailing zeros, so 5.2 is "5.2" and not "5.20000000000000".
+	int len = 0;
+	for (int precision=DBL_DIG; precision<=17; precision++) {
+		len = snprintf(buf, SLOG_NUMBER_BUFSIZE, "%.*g", precision, v);
+		if (strtod(buf, 0) == v) break;
+	}
+	return len;
+#endif
 }
 
-Slog& operator<< (Slog &s, const short &sh) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << sh;
-	s.partial(lvl,sstr.str());
-	return s;
+std::size_t
+slogFormatFloat(char *buf, const float v) {
+#ifdef __cpp_lib_to_chars
+	const std::to_chars_result r = std::to_chars(buf, buf+SLOG_NUMBER_BUFSIZE-1, v);
+	*r.ptr = '\0';
+	return r.ptr - buf;
+#else
+	int len = 0;
+	for (int precision=FLT_DIG; precision<=9; precision++) {
+		len = snprintf(buf, SLOG_NUMBER_BUFSIZE, "%.*g", precision, static_cast<double>(v));
+		if (strtof(buf, 0) == v) break;
+	}
+	return len;
+#endif
 }
 
-Slog& operator<< (Slog &s, const unsigned short &ush) {
+Slog& operator<< (Slog &s, const char *str) {
+	if (!s.isEnabled()) return s; // Do not bother formatting what will be thrown away
 	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << ush;
-	s.partial(lvl,sstr.str());
+	s.partial(lvl,str,strlen(str));
 	return s;
 }
 
-Slog& operator<< (Slog &s, const long &l) {
+Slog& operator<< (Slog &s, const std::string &str) {
+	if (!s.isEnabled()) return s; // Do not bother formatting what will be thrown away
 	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << l;
-	s.partial(lvl,sstr.str());
+	s.partial(lvl,str);
 	return s;
 }
 
-Slog& operator<< (Slog &s, const float &f) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << f;
-	s.partial(lvl,sstr.str());
-	return s;
-}
+// FIX: add more basic types here such as vector, deque, list, and ???
 
-Slog& operator<< (Slog &s, const double &d) {
-	int lvl = s.getMsgLevel();
-	stringstream sstr;
-	sstr << d;
-	s.partial(lvl,sstr.str());
+//////////////////////////////////////////////////////////////////////
+// More complicated insertion operators
+//////////////////////////////////////////////////////////////////////
+
+
+Slog& operator<< (Slog &s, const Where &w) {
+	s.SetLocation(w);
 	return s;
 }
 
-Slog& operator<< (Slog &s, const char *str) {
-	int lvl = s.getMsgLevel();
-	s.partial(lvl,string(str));
+Slog& operator<< (Slog &s, const SlogSite &site) {
+	s.SetLocation(site);
 	return s;
 }
 
-Slog& operator<< (Slog &s, const std::string &str) {
-	int lvl = s.getMsgLevel();
-	s.partial(lvl,str);
+Slog& operator<< (Slog &s, const SlogLimited &limited) {
+	if (0<limited.suppressed) s << '[' << limited.suppressed << " suppressed] ";
 	return s;
 }
 
-// FIX: add more basic types here such as vector, deque, list, and ???
-
 //////////////////////////////////////////////////////////////////////
-// More complicated insertion operators
+// SlogLimiter
 //////////////////////////////////////////////////////////////////////
 
+SlogLimited
+SlogLimiter::rate(const unsigned perSecond) {
+	// The coarse clock is plenty for whole seconds and is the cheapest to read
+	const SlogULongLong second = (readRawClock(CLOCK_SOURCE_COARSE)/1000000) & 0xffffffffUL;
+#ifdef CONCURRENT_BOOST
+	SlogULongLong old = state.load(boost::memory_order_relaxed);
+	SlogULongLong next;
+	do {
+		if (second!=old>>32) next = second<<32 | 1; // A new second
+		else if ((old & 0xffffffffUL) >= perSecond) return limit();
+		else next = old+1;
+	} while (!state.compare_exchange_weak(old, next, boost::memory_order_relaxed));
+#else
+	if (second!=state>>32) state = second<<32 | 1;
+	else if ((state & 0xffffffffUL) >= perSecond) return limit();
+	else state++;
+#endif
+	return pass();
+}
+
+SlogLimited
+SlogLimiter::sample(const unsigned k) {
+#ifdef CONCURRENT_BOOST
+	const SlogULongLong count = state.fetch_add(1, boost::memory_order_relaxed);
+#else
+	const SlogULongLong count = state++;
+#endif
+	if (1<k && 0!=count%k) return limit();
+	return pass();
+}
 
-Slog& operator<< (Slog &s, const Where &w) {
-	s.SetLocation(w);
-	return s;
+SlogLimited
+SlogLimiter::limit(void) {
+#ifdef CONCURRENT_BOOST
+	suppressed.fetch_add(1, boost::memory_order_relaxed);
+#else
+	suppressed++;
+#endif
+	return SlogLimited(true, 0);
+}
+
+SlogLimited
+SlogLimiter::pass(void) {
+#ifdef CONCURRENT_BOOST
+	return SlogLimited(false, suppressed.exchange(0, boost::memory_order_relaxed));
+#else
+	const unsigned long count = suppressed;
+	suppressed = 0;
+	return SlogLimited(false, count);
+#endif
 }
 
 
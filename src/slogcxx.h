@@ -18,10 +18,14 @@
 // C headers
 #include <cassert>
 #include <climits>
+#include <cstring> // strlen for SlogBuffer
+#include <cstddef>
 
 // C++ headers
 #include <string>
 #include <vector>
+#include <deque>
+#include <map>
 
 #include <iostream>
 #include <fstream>
@@ -29,6 +33,7 @@
 // If we're going to try to do this with Boost concurrency mechanisms to make it thread safe, boost headers
 #ifdef CONCURRENT_BOOST
 #include "boost/thread.hpp"
+#include "boost/atomic.hpp"
 #endif
 
 //////////////////////////////////////////////////////////////////////
@@ -53,6 +58,27 @@
 #endif
 #endif // ifndef UNUSED
 
+/// Lets C++14 compilers do work at compile time that older ones do at runtime
+#if __cplusplus >= 201402L
+#define SLOG_CONSTEXPR constexpr
+#else
+#define SLOG_CONSTEXPR inline
+#endif
+
+/// \brief At least 64 bit integers, for times in microseconds, hashes and numbers
+///
+/// C++98 has no long long, though every compiler has it.  The pragmas keep
+/// g++ -std=c++98 -pedantic quiet about it.
+#if __cplusplus < 201103L && defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wlong-long"
+#endif
+typedef long long SlogLongLong;
+typedef unsigned long long SlogULongLong;
+#if __cplusplus < 201103L && defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
 /// Simple macro to terminate execution early while debugging
 #define EXIT_DEBUG(why) std::cerr << "EXIT_DEBUG called at " \
 << __FILE__ << ":" << __LINE__<<": in function '" <<__FUNCTION__ << "'\n" \
@@ -64,36 +90,79 @@ exit(EXIT_FAILURE);
  Slog l;
  l << WHERE << "Example of recording where in the code we are" << endl;
  \endcode
+ Each WHERE is a static SlogSite for that spot in the code, made the first time it
+ is reached, and the message just keeps a pointer to it.  Before C++11 there is no
+ way to make a static inside an expression, so WHERE is a temporary Where instead,
+ and the message keeps a copy of it.
  */
 #if !defined (NLOG)
-#define WHERE Where(__FILE__,__LINE__,__FUNCTION__)
+#if __cplusplus >= 201103L
+#define WHERE ([](const char *function) -> const SlogSite & {	\
+	static const SlogSite site(SLOG_FILE,__LINE__,function);	\
+	return site; }(__FUNCTION__))
+#else
+#define WHERE Where(SLOG_FILE,__LINE__,__FUNCTION__)
+#endif
+#endif
+
+/// Where the leaf name starts in a path like __FILE__
+SLOG_CONSTEXPR std::size_t slogBasenameOffset(const char *path)
+{
+	std::size_t leaf = 0;
+	for (std::size_t i=0; '\0'!=path[i]; i++)
+		if ('/'==path[i] || '\\'==path[i]) leaf = i+1;
+	return leaf;
+}
+
+/// Forces a value to be worked out at compile time
+template <std::size_t N> struct SlogConstant {
+	static const std::size_t value = N; ///< The value
+};
+
+/// \brief __FILE__ without the directories
+///
+/// Some systems, including MacOS, give full filenames for __FILE__, which can be pretty
+/// distracting on output.  With C++14 the compiler finds the leaf name, so it costs nothing
+/// when logging.
+#if __cplusplus >= 201402L
+#define SLOG_FILE (__FILE__ + SlogConstant<slogBasenameOffset(__FILE__)>::value)
+#else
+#define SLOG_FILE (__FILE__ + slogBasenameOffset(__FILE__))
 #endif
 
 //////////////////////////////////////////////////////////////////////
 // Where class
 //////////////////////////////////////////////////////////////////////
 
-/// \brief A class to allow the WHERE macro to work
+/// \brief A spot in the source code, for the WHERE macro
 ///
-/// Pretty darn simple object.  Should it have a method to generate xml and non-xml versions?
+/// Only pointers to strings that live forever, like __FILE__ and __FUNCTION__, are kept,
+/// so a Where is small and cheap to make.  The WHERE macro makes just one per call site.
 
 #ifndef NLOG
 class Where {
 public: 
-    /// Basic constructor that takes __FILE__,__LINE__ and __FUNCTION__
-    Where(const std::string &_file, const int _lineno, const std::string &_function);
-	Where(void) : lineno(0) {}
-    inline std::string const &getFile() const {return file;};
-    inline int const &getLineno() const {return lineno;};
-    inline std::string const &getFunction() const {return function;};
-	bool operator!=(const Where& other) const
-	{
-		return file != other.file || lineno != other.lineno || function != other.function;
-	}
+    /// Basic constructor that takes the leaf of __FILE__ (see SLOG_FILE), __LINE__ and __FUNCTION__
+    Where(const char *_file, const int _lineno, const char *_function)
+	: file(_file), lineno(_lineno), function(_function) {}
+    inline const char *getFile() const {return file;};
+    inline int getLineno() const {return lineno;};
+    inline const char *getFunction() const {return function;};
 private:
-    std::string file; 	///< The results of __FILE__
+    const char *file; 	///< The leaf name from __FILE__
     int lineno;		///< The results of __LINE__
-    std::string function;	///< The results of __FUNCTION__
+    const char *function;	///< The results of __FUNCTION__
+};
+
+/// \brief The static Where that WHERE makes for each call site
+///
+/// It lasts as long as the program, so a message keeps just a pointer to it rather
+/// than a copy.
+class SlogSite : public Where {
+public:
+    /// Same arguments as Where
+    SlogSite(const char *_file, const int _lineno, const char *_function)
+	: Where(_file,_lineno,_function) {}
 };
 #endif // NLOG
 
@@ -125,17 +194,201 @@ enum LogLevelsEnum {
 	NEVER = INT_MAX // Only use for entries()
 };
 
+/*! \brief The most verbose level that gets compiled in
+ Build with -DSLOGCXX_MAX_LEVEL=TRACE, say, and VERBOSE and BOMBASTIC messages are
+ gone for good.  The check in isEnabled() is against a constant, so SLOG(log,VERBOSE)
+ statements compile to nothing and the SDEBUG and SINFO ones below to setting the
+ message level, which sticks for the statements after.  Levels up to
+ SLOGCXX_MAX_LEVEL still follow setLevel(), inc() and dec() at runtime.  A plain
+ log << VERBOSE << ... statement is still built, but is dropped at runtime.
+ */
+#ifndef SLOGCXX_MAX_LEVEL
+#define SLOGCXX_MAX_LEVEL NEVER
+#endif
+
+/// \brief A message level known at compile time, for SDEBUG and friends
+///
+/// log << SlogLevel<VERBOSE>() is log << VERBOSE, unless VERBOSE is over SLOGCXX_MAX_LEVEL.
+/// Then the message level is still set, but the rest of the statement goes to a SlogNull
+/// and compiles away.
+template <int Lvl> struct SlogLevel {};
+
 /// @brief Traditional syslog(3)-like error levels, for manipulators
-#define SDEBUG		BOMBASTIC << "debug: "
-#define SINFO		VERBOSE << "info: "
-#define SNOTICE		TRACE << "notice: "
-#define SWARNING	TERSE << "warning: "
-#define SERROR		LACONIC << "error: "
+#define SDEBUG		SlogLevel<BOMBASTIC>() << "debug: "
+#define SINFO		SlogLevel<VERBOSE>() << "info: "
+#define SNOTICE		SlogLevel<TRACE>() << "notice: "
+#define SWARNING	SlogLevel<TERSE>() << "warning: "
+#define SERROR		SlogLevel<LACONIC>() << "error: "
+
+/*! \brief Skip a whole << log statement, arguments and all, unless its level would get logged.
+ \code
+ SLOG(log,BOMBASTIC) << "state: " << expensiveDump() << endl;
+ \endcode
+ This is the same as log << BOMBASTIC << ..., so the message level sticks around
+ afterwards, but when BOMBASTIC is not enabled the cost is one comparison.
+ With NLOG, nothing in the statement is ever evaluated.
+ */
+#if !defined(NLOG)
+#define SLOG(log,lvl) if (!(log).isEnabled(lvl)) {} else (log) << LogLevelsEnum(lvl)
+#else
+#define SLOG(log,lvl) if (true) {} else (log) << LogLevelsEnum(lvl) // Not even log or lvl get evaluated
+#endif
+
+#if !defined(NLOG) && __cplusplus >= 201103L
+/// The SlogLimiter for the statement this is in
+#define SLOG_SITE_LIMITER() ([]() -> SlogLimiter & { static SlogLimiter site; return site; }())
+/*! \brief Like SLOG, but log at most perSecond records a second from this statement
+ \code
+ for (;;) if (!read(fd,buf,len)) SLOG_RATE(log,LACONIC,10) << "read failed: " << errno << endl;
+ \endcode
+ Each statement has its own SlogLimiter, checked without a lock before anything
+ is formatted.  The next record that does get out starts with how many were
+ skipped, such as "[120 suppressed] read failed: 5".  Needs C++11 for a static
+ inside the statement.  Older compilers get plain SLOG.
+ */
+#define SLOG_RATE(log,lvl,perSecond) if (!(log).isEnabled(lvl)) {}		\
+	else if (SlogLimited slogLimited_ = SLOG_SITE_LIMITER().rate(perSecond)) {}	\
+	else (log) << LogLevelsEnum(lvl) << slogLimited_
+/// \brief Like SLOG_RATE, but log only the first of every k records from this statement
+#define SLOG_SAMPLE(log,lvl,k) if (!(log).isEnabled(lvl)) {}			\
+	else if (SlogLimited slogLimited_ = SLOG_SITE_LIMITER().sample(k)) {}	\
+	else (log) << LogLevelsEnum(lvl) << slogLimited_
+#else
+#define SLOG_RATE(log,lvl,perSecond) SLOG(log,lvl)
+#define SLOG_SAMPLE(log,lvl,k) SLOG(log,lvl)
+#endif
+
+/// @brief What an asynchronous Slog does when its queue of pending records is full
+enum SlogOverflowPolicy {
+	OVERFLOW_BLOCK,		///< Wait for the writer thread to make room
+	OVERFLOW_DROP_NEWEST,	///< Throw away the record being logged
+	OVERFLOW_DROP_OLDEST	///< Throw away the oldest record still waiting to be written
+};
+
+#if !defined(NLOG)
+/// \brief What a SlogLimiter decided for one record.  True means it was held back.
+struct SlogLimited {
+	SlogLimited(const bool limited, const unsigned long suppressed) : limited(limited), suppressed(suppressed) {}
+	operator bool() const {return limited;}
+	bool limited;		///< This record does not get logged
+	unsigned long suppressed;	///< How many were held back before this one, if it gets logged
+};
+
+/// \brief Per statement state for SLOG_RATE and SLOG_SAMPLE
+///
+/// Lock free with CONCURRENT_BOOST.  A rate limit counts records in each whole second.
+class SlogLimiter {
+public:
+	SlogLimiter() : state(0), suppressed(0) {}
+	/// Let through at most perSecond records in a second
+	SlogLimited rate(const unsigned perSecond);
+	/// Let through the first of every k records
+	SlogLimited sample(const unsigned k);
+private:
+	/// Count one that is held back
+	SlogLimited limit(void);
+	/// Let one through, taking the count of those held back before it
+	SlogLimited pass(void);
+#ifdef CONCURRENT_BOOST
+	boost::atomic<SlogULongLong>	state;	///< Rate: second in the high 32 bits, count in the low.  Sample: count.
+	boost::atomic<unsigned long>	suppressed;	///< Held back since the last one let through
+#else
+	SlogULongLong state;	///< Rate: second in the high 32 bits, count in the low.  Sample: count.
+	unsigned long suppressed;	///< Held back since the last one let through
+#endif
+};
+#endif
+
+/// Room for the longest time stamp, "YYYY-MM-DDTHH:MM:SS.uuuuuuZ" with a wide year
+#define SLOG_TIME_BUFSIZE 48
+
+/// @brief How entry time stamps are written
+enum SlogTimeFormat {
+	TIME_EPOCH_MICROS,	///< Seconds since 1970 to the microsecond: 1150920000.123456
+	TIME_ISO8601		///< UTC date and time to the microsecond: 2006-06-21T19:20:00.123456Z
+};
+
+/// @brief Where entry time stamps come from
+enum SlogClockSource {
+	CLOCK_SOURCE_REALTIME,	///< The system clock.  Follows any adjustments to the time of day.
+	CLOCK_SOURCE_MONOTONIC,	///< Never jumps backwards, so differences are good for measuring latency.
+				///< Lined up with the system clock when selected.
+	CLOCK_SOURCE_COARSE	///< The system clock at tick resolution (a few ms) where that is cheaper to read
+};
+
+/// @brief The ways a sink can have its records written
+enum SlogSinkFormat {
+	FORMAT_CONSOLE,	///< Scope depth, indent and scope name before the message.  What cerr gets.
+	FORMAT_TEXT,	///< Time, location and scope name before the message
+	FORMAT_XML,	///< <entry> elements inside <scope> elements
+	FORMAT_BINARY	///< Tagged binary records.  Nothing is turned into text.  See SlogDecoder.
+};
+/// How many SlogSinkFormat values there are
+#define SLOG_FORMAT_COUNT 4
+
+/*!
+ \brief Record types in FORMAT_BINARY output
+ 
+ Every record is a type byte, a 4 byte payload length and the payload.  Numbers
+ are in the byte order of the machine that wrote them, which the header records.
+ A file starts with a header, and appending to a file adds another one.  Call
+ sites and scope names are given ids by definition records the first time each
+ one shows up, so entries only carry the ids.  An id may be defined again later,
+ and the newest definition is the one that counts.
+ */
+enum SlogBinaryRecord {
+	SLOG_BIN_HEADER='H',	///< "slogcxx" and a nul, u32 0x01020304 for byte order, u32 version
+	SLOG_BIN_LOCATION='L',	///< u32 id, i32 line, u32 length and file name, u32 length and function name
+	SLOG_BIN_SCOPE='N',	///< u32 id, u32 length and scope name
+	SLOG_BIN_PUSH='P',	///< u32 scope id of a new innermost scope
+	SLOG_BIN_POP='O',	///< Leave the innermost scope.  No payload.
+	SLOG_BIN_ENTRY='E',	///< i32 level, i64 microseconds since 1970 (LLONG_MIN if no time), u32 location id (0 if none), then the arguments
+	SLOG_BIN_TEXT='T'	///< Text that goes out as it is, such as from writeState()
+};
+
+/// Version in the SLOG_BIN_HEADER record
+#define SLOG_BINARY_VERSION 1
+
+/// \brief Argument tags in a SLOG_BIN_ENTRY record
+enum SlogBinaryArg {
+	SLOG_ARG_SIGNED='i',	///< 8 byte signed integer
+	SLOG_ARG_UNSIGNED='u',	///< 8 byte unsigned integer
+	SLOG_ARG_DOUBLE='d',	///< 8 byte double
+	SLOG_ARG_FLOAT='f',	///< 4 byte float
+	SLOG_ARG_STRING='s'	///< u32 length and the characters
+};
 
 //////////////////////////////////////////////////////////////////////
 // The main slog class
 //////////////////////////////////////////////////////////////////////
 
+class Slog;
+class SlogBuffer;
+
+/// Base for SlogTraits specializations.  Its typedef is what switches on the operator<< template.
+struct SlogInsertable {
+	typedef Slog &result_type; ///< What operator<< returns
+};
+
+/*!
+ \brief Tells operator<< how to log a T
+ 
+ There is a specialization for every arithmetic type.  To log one of your own
+ types straight into the message, without building a std::string first, add
+ another one:
+ \code
+ template <> struct SlogTraits<Coord> : SlogInsertable {
+	 static void format(SlogBuffer &buf, const Coord &c) {
+		 buf.append('('); buf.appendDouble(c.x); buf.append(','); buf.appendDouble(c.y); buf.append(')');
+	 }
+ };
+ \endcode
+ Types without a specialization are left to the other operator<< overloads.
+ Enumerations are in that group too, so cast them to int or give them a
+ specialization of their own.
+ */
+template <typename T> struct SlogTraits {};
+
 
 /*!
  \brief simple logging class with a ostream like (<<) interface
@@ -196,31 +449,461 @@ enum LogLevelsEnum {
  0: No reason not to add your own XML <mytag>some info</mytag>
  0: stopped logging
  \endverbatim
- And xml is written to the log file.  Note that there is currently a bug with writing the time.  Scientific notation is not helpful.
+ And xml is written to the log file.  Time stamps are seconds since 1970 to the microsecond
+ unless setTimeFormat() asks for ISO 8601.
  \verbatim
  <slogcxx>
- <entry time="1.15092e+09">started logging</entry>
- <entry time="1.15092e+09">argc 1</entry>
- <entry time="1.15092e+09">argv[0] ./a.out</entry>
- <entry time="1.15092e+09">The WHERE object marks a location in the code <where file="foo.C" line="8" function="main" /></entry>
+ <entry time="1150920000.001371">started logging</entry>
+ <entry time="1150920000.002742">argc 1</entry>
+ <entry time="1150920000.004113">argv[0] ./a.out</entry>
+ <entry time="1150920000.005484">The WHERE object marks a location in the code <where file="foo.C" line="8" function="main" /></entry>
  <scope name="scope name here">
- <entry time="1.15092e+09" scope="scope name here">LogState will pop a log scope when it is destroyed</entry>
+ <entry time="1150920000.006855" scope="scope name here">LogState will pop a log scope when it is destroyed</entry>
  <scope name="two">
- <entry time="1.15092e+09" scope="two">Here is another log scope</entry>
+ <entry time="1150920000.008226" scope="two">Here is another log scope</entry>
  </scope> <!-- two -->
  </scope> <!-- scope name here -->
- <entry time="1.15092e+09">Not all of a log message will show up</entry>
- <entry time="1.15092e+09">No reason not to add your own XML <mytag>some info</mytag></entry>
- <entry time="1.15092e+09">stopped logging</entry>
+ <entry time="1150920000.009597">Not all of a log message will show up</entry>
+ <entry time="1150920000.010968">No reason not to add your own XML <mytag>some info</mytag></entry>
+ <entry time="1150920000.012339">stopped logging</entry>
  </slogcxx>
  \endverbatim
  
  
- \todo get fractions of a second into the time entry
  \todo get people other than Kurt to write a bit of documentation.
  */
 
 #if !defined(NLOG)
+
+/*!
+ \brief A setting that any thread may change while others read it, with no lock either way
+ 
+ With CONCURRENT_BOOST this is a boost::atomic used with relaxed ordering.  A reader
+ sees the old value or the new one, never a torn one, and nothing else is ordered by
+ it, so on x86 and ARM a read is a plain load.  Without threads it is just a T.
+ */
+template <typename T>
+class SlogAtomic {
+public:
+	SlogAtomic(const T v) : value(v) {} ///< Start off at v
+#ifdef CONCURRENT_BOOST
+	T load(void) const {return value.load(boost::memory_order_relaxed);} ///< The current value
+	void store(const T v) {value.store(v, boost::memory_order_relaxed);} ///< Change the value
+	/// \brief Add delta, but stop at floor.  Safe against other threads doing the same.
+	/// @return the new value
+	T add(const T delta, const T floor) {
+		T old = load();
+		T next;
+		do {
+			next = old+delta < floor ? floor : old+delta;
+		} while (!value.compare_exchange_weak(old, next, boost::memory_order_relaxed));
+		return next;
+	}
+#else
+	T load(void) const {return value;}
+	void store(const T v) {value = v;}
+	T add(const T delta, const T floor) {
+		value = value+delta < floor ? floor : value+delta;
+		return value;
+	}
+#endif
+	operator T() const {return load();} ///< Read like a plain T
+	SlogAtomic &operator=(const T v) {store(v); return *this;} ///< Write like a plain T
+private:
+	SlogAtomic(const SlogAtomic&);		///< Not copyable
+	SlogAtomic &operator=(const SlogAtomic&);	///< Not copyable
+#ifdef CONCURRENT_BOOST
+	boost::atomic<T> value;	///< The setting
+#else
+	T value;		///< The setting
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////
+// Sinks
+//////////////////////////////////////////////////////////////////////
+
+/*!
+ \brief Somewhere finished log records go
+ 
+ A Slog can have any number of sinks.  Each record is formatted once for every
+ format the sinks use, and then each sink that wants the record gets the text
+ in its own format.  Subclass this to send records somewhere new.  The Slog
+ only calls one sink at a time, so write() does not need any locking of its own.
+ */
+class SlogSink {
+public:
+	/// @param format How this sink wants its records written
+	/// @param level Take entries at this level or lower.  NEVER takes everything the Slog lets out.
+	SlogSink(const SlogSinkFormat format, const int level=NEVER) : format(format), level(level) {}
+	virtual ~SlogSink() {}
+	
+	/// \brief Take one record
+	/// @param lvl What level the entry was logged at.  XML scope tags come with NEVER.
+	/// @param text The record in this sink's format, newline included
+	virtual void write(const int lvl, const std::string &text) = 0;
+	/// Push out anything being held back
+	virtual void flush(void) {}
+	/// Is something being held back that flush() would push out?
+	virtual bool pending(void) const {return false;}
+	/// Only sinks that buffer care.  See Slog::setFlushPolicy.
+	virtual void setFlushPolicy(UNUSED const std::size_t bytes, UNUSED const double seconds, UNUSED const int level) {}
+	
+	/// @name Crash handling.  See Slog::enableCrashHandler().
+	///
+	/// These are called from a signal handler, so they may only make async-signal-safe
+	/// calls: no locks, no allocation and no streams.  The defaults drop everything.
+	///@{
+	/// Write out whatever is being held back
+	virtual void crashFlush(void) {}
+	/// Write text straight out
+	virtual void crashWrite(UNUSED const char *text, UNUSED const std::size_t len) {}
+	/// Finish the file off and get it onto the disk.  Nothing more is written after this.
+	virtual void crashClose(void) {}
+	///@}
+	
+	/// How this sink wants records written
+	SlogSinkFormat getFormat(void) const {return format;}
+	/// Change the format.  Only do this when no other thread is logging to the Slog, or
+	/// records already on their way can miss the sink.
+	void setFormat(const SlogSinkFormat f) {format=f;}
+	/// The least important level this sink takes
+	int getLevel(void) const {return level;}
+	/// Change the level.  Logging threads read it without a lock, so this can be done any time.
+	void setLevel(const int lvl) {level=lvl;}
+private:
+	SlogSink(const SlogSink&);		///< Not copyable
+	SlogSink &operator=(const SlogSink&);	///< Not copyable
+	
+	SlogAtomic<SlogSinkFormat> format;	///< How records are written for this sink
+	SlogAtomic<int> level;	///< Entries above this level are not for this sink
+};
+
+/// \brief Write records to an ostream, cerr unless you say otherwise
+class SlogConsoleSink : public SlogSink {
+public:
+	/// @param out Where to write.  It has to last as long as the sink.
+	SlogConsoleSink(std::ostream &out=std::cerr, const SlogSinkFormat format=FORMAT_CONSOLE, const int level=NEVER)
+		: SlogSink(format,level), out(out) {}
+	void write(const int lvl, const std::string &text);
+	void flush(void);
+	/// Only cerr can be written to from a signal handler, as file descriptor 2
+	void crashWrite(const char *text, const std::size_t len);
+private:
+	std::ostream &out;	///< Where the records go
+};
+
+/// \brief Write records to a file in large, buffered writes
+///
+/// XML files are wrapped in a <slogcxx> element, and binary files start with a header record.
+class SlogFileSink : public SlogSink {
+public:
+	/// @param filename File to write to
+	/// @param append Set false to overwrite a file that is already there
+	SlogFileSink(const std::string &filename, const bool append=true,
+		     const SlogSinkFormat format=FORMAT_XML, const int level=NEVER);
+	/// Writes out the buffer and closes the file
+	~SlogFileSink();
+	/// Did the file open?
+	bool isOpen(void) const {return file && file->is_open();}
+	void write(const int lvl, const std::string &text);
+	void flush(void);
+	bool pending(void) const {return !buffer.empty();}
+	void setFlushPolicy(const std::size_t bytes, const double seconds, const int level);
+	void crashFlush(void);
+	void crashWrite(const char *text, const std::size_t len);
+	void crashClose(void);
+	/// \brief Start a new file when this one gets too big or has been open too long
+	///
+	/// The full file becomes filename.1, filename.1 becomes filename.2 and so on, and
+	/// only the newest keep old files are kept.  The next file is opened ahead of time as
+	/// filename.next, so rotating is just swapping streams.  That name is only ever made
+	/// new: if a file is already there (say from a program that died mid rotation), the
+	/// spare is filename.next.1, filename.next.2 and so on.  With CONCURRENT_BOOST, a
+	/// background thread closes the old file and does the renames.  If it has not
+	/// finished by the next rotation, that rotation waits for a later write rather than
+	/// holding this one up.  If the current file cannot be renamed to filename, it keeps
+	/// its spare name and rotating stops.
+	///
+	/// A new XML file starts with <slogcxx>, but scopes still open in the old file are not
+	/// opened again.  Only the first binary file has a header, so decode the files
+	/// together, oldest first.
+	/// @param bytes Rotate when the file gets to this size.  0 for no limit.
+	/// @param seconds Rotate when the file has been open this long.  0 for no limit.
+	/// @param keep How many old files to keep
+	void setRotation(const std::size_t bytes, const double seconds=0, const unsigned keep=5);
+	/// How many times the file has been rotated
+	unsigned getRotations(void) const {return rotations;}
+private:
+	/// Swap in the spare file
+	void rotate(void);
+	/// \brief Write out and close the old file, move the names along and open a new spare
+	/// @param current What the new current file is called until it is renamed to filename
+	/// @param format The format the new spare starts off in
+	void retire(std::ofstream *old, std::string *tail, const int oldFd, const std::string current,
+		    const SlogSinkFormat format);
+	/// Make a new file named filename.next, or the first free filename.next.N, for the next rotation
+	void openSpare(const SlogSinkFormat format);
+	std::string filename;	///< Name of the current file
+	std::ofstream *file;	///< Where the records go
+	std::ofstream *spare;	///< Opened ahead for the next rotation, or null
+	std::string spareName;	///< What spare is called
+	bool renameFailed;	///< The current file could not be renamed to filename, so rotating stopped
+	int fd;			///< Another descriptor for file, for the crash handler.  -1 if none.
+	int spareFd;		///< Another descriptor for spare
+	std::size_t spareBytes;	///< Bytes already in spare
+	std::size_t fileBytes;	///< Size of the current file, counting what is in buffer
+	double opened;		///< When the current file was started
+	std::size_t rotateBytes;	///< Rotate at this size.  0 for never.
+	double rotateSeconds;	///< Rotate at this age.  0 for never.
+	unsigned rotateKeep;	///< How many old files to keep
+	unsigned rotations;	///< How many times the file has been rotated
+#ifdef CONCURRENT_BOOST
+	boost::thread	*m_rotator;	///< Finishing the last rotation, or null
+	boost::atomic<bool>	m_spareReady;	///< Has m_rotator finished with spare?
+#endif
+	std::string buffer;	///< Output that has not been written yet
+	std::size_t flushBytes;	///< Write buffer out when it gets this big
+	double flushSeconds;	///< Write buffer out when it has been waiting this long
+	int flushLevel;		///< Write buffer out after entries at this level or lower
+	double lastFlush;	///< When buffer was last written out
+};
+
+#ifndef WIN32
+/*!
+ \brief Copy records into a memory mapped file
+
+ The file is made bigger a chunk at a time and mapped, so writing a record is a
+ memcpy.  Records are in the kernel's page cache as soon as they are copied, so
+ they are still there if the program crashes right after, when a buffered stream
+ would lose them.  The unused end of the last chunk is cut off when the sink is
+ destroyed.  After a crash it is left as nul bytes, which are skipped when
+ appending to a text or XML log and by SlogDecoder in a binary one.
+ */
+class SlogMmapSink : public SlogSink {
+public:
+	/// @param filename File to write to
+	/// @param append Set false to overwrite a file that is already there
+	/// @param chunkSize Grow the file by this many bytes at a time.  Rounded up to whole pages.
+	SlogMmapSink(const std::string &filename, const bool append=true,
+		     const SlogSinkFormat format=FORMAT_XML, const int level=NEVER,
+		     const std::size_t chunkSize=1<<20);
+	/// Cuts the file down to what was written and closes it
+	~SlogMmapSink();
+	/// Is the file open and mapped?  Goes false if the file could not be made bigger.
+	bool isOpen(void) const {return 0!=map;}
+	void write(const int lvl, const std::string &text);
+	/// Ask the kernel to start writing the dirty pages to disk
+	void flush(void);
+	/// Copies into the mapping if there is room.  Growing it is not safe in a signal handler.
+	void crashWrite(const char *text, const std::size_t len);
+	void crashClose(void);
+	/// Bytes of records in the file
+	std::size_t size(void) const {return used;}
+private:
+	/// Map at least needed bytes of the file.  @return false if that failed
+	bool grow(const std::size_t needed);
+	/// Unmap, cut off the unused end and close
+	void close(void);
+	int fd;			///< The open file, or -1
+	char *map;		///< Start of the mapping, or null
+	std::size_t mapped;	///< Length of the mapping and of the file
+	std::size_t used;	///< Bytes of records at the start of the mapping
+	std::size_t chunkSize;	///< How much to grow by
+};
+#endif
+
+#ifdef SLOGCXX_ZLIB
+struct z_stream_s; // From zlib.h, which only slogcxx.cpp needs
+
+/*!
+ \brief Write a gzip compressed log file
+
+ Records are collected into blocks, and each block is compressed and written
+ with a zlib sync flush, so everything handed over so far can be read back
+ while the file is still growing (see slogcxx-zcat -f).  With CONCURRENT_BOOST
+ the compression happens in a thread of its own.  When a block is handed over
+ follows the flush policy, as for SlogFileSink.  Appending adds another gzip
+ member, which gunzip reads as one file.
+
+ The crash handler cannot run zlib, so a crash loses the block being collected
+ and whatever is still being compressed.  Use a SlogFileSink or SlogMmapSink
+ alongside it for the records that matter.
+
+ Only there when slogcxx is built with SLOGCXX_ZLIB.  Link with -lz.
+ */
+class SlogGzipSink : public SlogSink {
+public:
+	/// @param filename File to write to, usually ending in .gz
+	/// @param append Set false to overwrite a file that is already there
+	/// @param compression zlib level from 1 (fastest) to 9 (smallest)
+	SlogGzipSink(const std::string &filename, const bool append=true,
+		     const SlogSinkFormat format=FORMAT_XML, const int level=NEVER, const int compression=6);
+	/// Compresses what is left, finishes the gzip stream and closes the file
+	~SlogGzipSink();
+	/// Did the file open?
+	bool isOpen(void) const {return file.is_open();}
+	void write(const int lvl, const std::string &text);
+	/// Hand over the current block and wait until it is all in the file
+	void flush(void);
+	bool pending(void) const {return !block.empty();}
+	void setFlushPolicy(const std::size_t bytes, const double seconds, const int level);
+private:
+	/// Send block off to be compressed
+	void handOff(void);
+	/// Compress data into the file with a zlib flush mode
+	void compress(const char *data, const std::size_t len, const int mode);
+	std::ofstream file;	///< Where the compressed data goes
+	z_stream_s *stream;	///< The compressor
+	std::string block;	///< Records that have not been handed over yet
+	std::size_t flushBytes;	///< Hand block over when it gets this big
+	double flushSeconds;	///< Hand block over when it has been waiting this long
+	int flushLevel;		///< Hand block over after entries at this level or lower
+	double lastFlush;	///< When block was last handed over
+	std::vector<std::string*> freeBlocks;	///< Compressed blocks, kept for their capacity
+#ifdef CONCURRENT_BOOST
+	/// Compress blocks until stopped
+	void compressLoop(void);
+	boost::thread	*m_compressor;	///< Runs compressLoop()
+	boost::mutex	m_blocksMutex;	///< Protects blocks, freeBlocks, m_stop and m_busy
+	boost::condition_variable	m_work;	///< Signalled when there is a block or it is time to stop
+	boost::condition_variable	m_idle;	///< Signalled when blocks has been emptied
+	std::deque<std::string*> blocks;	///< Waiting to be compressed, oldest first
+	bool	m_stop;		///< Finish up and exit compressLoop()
+	bool	m_busy;		///< Compressing a block that is no longer in blocks
+#endif
+};
+#endif
+
+/// \brief Keep records in memory.  Handy for tests and for showing recent history.
+class SlogMemorySink : public SlogSink {
+public:
+	/// @param maxRecords Keep only this many of the newest records.  0 keeps them all.
+	SlogMemorySink(const SlogSinkFormat format=FORMAT_TEXT, const int level=NEVER, const std::size_t maxRecords=0)
+		: SlogSink(format,level), maxRecords(maxRecords) {}
+	void write(const int lvl, const std::string &text);
+	/// Copy of the records held, oldest first
+	std::vector<std::string> getRecords(void);
+	/// How many records are held
+	std::size_t size(void);
+	/// Forget all the records
+	void clear(void);
+private:
+#ifdef CONCURRENT_BOOST
+	boost::mutex	m_recordsMutex;	///< The Slog writes while other threads read
+#endif
+	std::deque<std::string> records;	///< Oldest first
+	std::size_t maxRecords;	///< Most records to keep, or 0 for no limit
+};
+
+#ifdef CONCURRENT_BOOST
+/*!
+ \brief Bounded queue that any number of threads can push to and pop from without locking
+ 
+ This is Dmitry Vyukov's bounded MPMC queue.  Each cell carries a sequence number
+ that says whether it is ready to be filled or emptied on the current lap around
+ the ring, so a thread only has to win one compare-and-swap on a position counter
+ to own a cell.  Cells are filled and emptied in place: claim one, work on its data,
+ then publish or release it.  A claimed cell holds up the cells behind it, so do
+ not dawdle.
+ */
+template <typename T>
+class SlogRing {
+public:
+	/// One slot in the ring
+	struct Cell {
+		boost::atomic<std::size_t> sequence;	///< Where the cell is in its fill/empty cycle
+		std::size_t pos;	///< Position it was claimed at
+		T data;		///< What is being passed along
+	};
+	
+	/// @param size Room for at least this many entries.  Rounded up to a power of two.
+	explicit SlogRing(const std::size_t size) : enqueuePos(0), dequeuePos(0) {
+		std::size_t capacity = 2;
+		while (capacity < size) capacity *= 2;
+		mask = capacity-1;
+		cells = new Cell[capacity];
+		for (std::size_t i=0; i<capacity; i++) cells[i].sequence.store(i, boost::memory_order_relaxed);
+	}
+	~SlogRing() {delete [] cells;}
+	/// How many entries fit
+	std::size_t capacity(void) const {return mask+1;}
+	
+	/// Claim a cell to fill.  @return null if the ring is full
+	Cell *claimPush(void) {
+		std::size_t pos = enqueuePos.load(boost::memory_order_relaxed);
+		for (;;) {
+			Cell *cell = &cells[pos & mask];
+			const std::ptrdiff_t dif = std::ptrdiff_t(cell->sequence.load(boost::memory_order_acquire)) - std::ptrdiff_t(pos);
+			if (0==dif) {
+				if (enqueuePos.compare_exchange_weak(pos, pos+1, boost::memory_order_relaxed)) {
+					cell->pos = pos;
+					return cell;
+				}
+			} else if (0>dif) {
+				return 0; // Still holds an entry from the last lap
+			} else {
+				pos = enqueuePos.load(boost::memory_order_relaxed); // Someone else got it
+			}
+		}
+	}
+	/// Hand a filled cell over to the poppers
+	void publish(Cell *cell) {cell->sequence.store(cell->pos+1, boost::memory_order_seq_cst);}
+	
+	/// Claim the oldest filled cell.  @return null if the ring is empty
+	Cell *claimPop(void) {
+		std::size_t pos = dequeuePos.load(boost::memory_order_relaxed);
+		for (;;) {
+			Cell *cell = &cells[pos & mask];
+			const std::ptrdiff_t dif = std::ptrdiff_t(cell->sequence.load(boost::memory_order_acquire)) - std::ptrdiff_t(pos+1);
+			if (0==dif) {
+				if (dequeuePos.compare_exchange_weak(pos, pos+1, boost::memory_order_relaxed)) {
+					cell->pos = pos;
+					return cell;
+				}
+			} else if (0>dif) {
+				return 0; // Not filled yet
+			} else {
+				pos = dequeuePos.load(boost::memory_order_relaxed);
+			}
+		}
+	}
+	/// Give an emptied cell back to the pushers for the next lap
+	void release(Cell *cell) {cell->sequence.store(cell->pos+mask+1, boost::memory_order_release);}
+	
+	/// \brief The i'th oldest filled cell, without claiming it.  @return null past the newest one
+	///
+	/// Only for the crash handler.  Nothing stops the cell being popped and reused while it is read.
+	const Cell *peek(const std::size_t i) const {
+		const std::size_t pos = dequeuePos.load(boost::memory_order_acquire)+i;
+		const Cell *cell = &cells[pos & mask];
+		return cell->sequence.load(boost::memory_order_acquire)==pos+1 ? cell : 0;
+	}
+	
+	/// Is the oldest cell still unfilled?  Sequentially consistent, so it can pair with a flag
+	/// to make sure a sleeping consumer is never missed.
+	bool empty(void) const {
+		const std::size_t pos = dequeuePos.load(boost::memory_order_seq_cst);
+		return cells[pos & mask].sequence.load(boost::memory_order_seq_cst) != pos+1;
+	}
+private:
+	SlogRing(const SlogRing&);		///< Not copyable
+	SlogRing &operator=(const SlogRing&);	///< Not copyable
+	
+	Cell *cells;		///< The ring
+	std::size_t mask;	///< capacity-1, to turn positions into indexes
+	// Keep the two counters on their own cache lines so pushers and poppers do not fight over them
+	char pad0[64];		///< Cache line padding
+	boost::atomic<std::size_t> enqueuePos;	///< Next position to fill
+	char pad1[64];		///< Cache line padding
+	boost::atomic<std::size_t> dequeuePos;	///< Next position to empty
+	char pad2[64];		///< Cache line padding
+};
+
+/// Record text up to this size rides in the ring slot itself.  Longer records use a pooled string.
+#define SLOG_SLOT_PAYLOAD 240
+#endif // CONCURRENT_BOOST
+
 class Slog {
 public:
 	/// \brief simple console constructor using cerr
@@ -242,57 +925,83 @@ public:
 	/// @param append	Flag: set true to append to the current file; otherwise overwrite
 	void AddLogFileOutput(const std::string& filename, const bool append);
 	
+	/// @name Sinks
+	///
+	/// Every Slog starts with a console sink on cerr, plus a file sink if it was given a file
+	/// name.  Those two are the ones AddLogFileOutput() and the XML control work on.  More
+	/// can be added, and each one only gets the entries at or below its own level.
+	///@{
+	/// Send records to sink as well.  The Slog owns it from now on and deletes it.
+	void addSink(SlogSink *sink);
+	/// Stop sending records to sink and delete it
+	/// @return false if sink does not belong to this Slog
+	bool removeSink(SlogSink *sink);
+	/// The console sink the Slog started with, or null if it has been removed
+	SlogSink *getConsoleSink(void) {return rootLog ? rootLog->getConsoleSink() : consoleSink;}
+	/// The file sink from the constructor or AddLogFileOutput(), or null if there is none
+	SlogSink *getFileSink(void) {return rootLog ? rootLog->getFileSink() : fileSink;}
+	///@}
+	
 	/// @name Verbosity
 	//@{
 	/// This controls the amount of output
-	void setLevel(const int lvl)
-	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		assert(0<=lvl);logLevel=lvl;
-	} 
+	void setLevel(const int lvl);
 	/// What is the current verbosity level?  Higher means more spewage
 	int getLevel(void)
 	{
 		return logLevel;
 	}
-	/// Ask for more pain (err... log messages)
-	int inc(void)
+	/// Would a message at level lvl get logged?  Cheap enough to ask before formatting anything.
+	/// Levels over SLOGCXX_MAX_LEVEL never are.
+	bool isEnabled(const int lvl) const
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		return ++logLevel;
+		return lvl<=SLOGCXX_MAX_LEVEL && lvl<=logLevel;
 	}
-	/// Stick your head in the sand (ostrich mode)... see fewer log messages
-	int dec(void)
+	/// Would the << message being built right now get logged?
+	bool isEnabled(void) const
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		--logLevel;
-		if (0>logLevel) logLevel=0;
-		return logLevel;
+		return isEnabled(msgLevel);
 	}
+	/// Ask for more pain (err... log messages)
+	int inc(void);
+	/// Stick your head in the sand (ostrich mode)... see fewer log messages
+	int dec(void);
 	//@}
 	
+	/// @name Named loggers
+	///
+	/// A Slog hands out named loggers, such as "net.rpc" and "db.pool", for the parts of a
+	/// program.  Each one is a Slog with a level, message level and partial messages of its
+	/// own.  Everything it logs, scopes included, goes out through the Slog it came from, with
+	/// that Slog's sinks, time stamps and other settings.  Set those on that Slog: asking a
+	/// named logger to change them has no effect, apart from the sink calls and flush(),
+	/// which are passed along.
+	///
+	/// Until setLevel(), inc() or dec() is used on it, a logger follows the level of the one
+	/// above it: "net" for "net.rpc", and the Slog itself for "net".  Followers are updated
+	/// whenever a level changes, so checking a level is still a single read.
+	///@{
+	/// \brief The logger called name, made the first time it is asked for
+	///
+	/// Loggers above it that do not exist yet are made too.  The loggers belong to the Slog
+	/// and go away with it.  Asking a named logger is the same as asking the Slog it came from.
+	Slog &getLogger(const std::string &name);
+	/// Go back to following the level of the logger above.  Does nothing to the Slog at the top.
+	void inheritLevel(void);
+	/// The name getLogger() was given, or an empty string for the Slog at the top
+	const std::string &getName(void) const {return name;}
+	///@}
+	
 	/// @name Time control
 	//@{
 	/// turn on time stamping in log entries
 	void enableTime(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		timeEnabled=true;
 	}
 	/// turn off time stamping in log entries
 	void disableTime(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		timeEnabled=false;
 	}
 	/// return true if time logging is on
@@ -300,30 +1009,49 @@ public:
 	{
 		return timeEnabled;
 	}
+	/// \brief Pick the time stamp format and the clock it reads
+	///
+	/// The seconds part of a time stamp is formatted once per second and reused, so
+	/// each entry only renders the microseconds.
+	void setTimeFormat(const SlogTimeFormat format, const SlogClockSource clock=CLOCK_SOURCE_REALTIME);
+	/// @return the current time stamp format
+	SlogTimeFormat getTimeFormat(void) const
+	{
+		return timeFormat;
+	}
+	/// @return the clock that time stamps are read from
+	SlogClockSource getClockSource(void) const
+	{
+		return clockSource;
+	}
 	//@}
 	
-	/// @name XML control - only applies to log files.
+	/// @name Repeated message collapsing
+	///
+	/// With collapsing on, an entry that is the same as the one before it (same text,
+	/// level, location and scope) is counted rather than logged.  When something else
+	/// gets logged, a scope is pushed or popped, or flush() is called, a single
+	/// "last message repeated N times (first ..., last ...)" entry goes out instead.
+	/// Entries are compared by a 64 bit FNV-1a hash, not by their text.
+	//@{
+	/// Start collapsing repeated entries
+	void enableCollapse(void);
+	/// Stop collapsing, and log the count for any repeats being held
+	void disableCollapse(void);
+	/// return true if repeated entries are being collapsed
+	bool getCollapseStatus(void) const {return collapseEnabled;}
+	//@}
+	
+	/// @name XML control - only applies to the file sink from the constructor or AddLogFileOutput().
 	///
 	/// Generally you will want to just leave XML logging on.  You can
 	/// get unbalanced begin and end log tags if the state is different
 	/// at the log contruction/destruction.
 	//@{
 	/// Switch to xml encoding of log messages
-	void enableXml(void)
-	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		xmlEnabled=true;
-	}
+	void enableXml(void);
 	/// Switch back to text mode
-	void disableXml(void)
-	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		xmlEnabled=false;
-	}
+	void disableXml(void);
 	/// Are we in xml output mode?
 	bool getXmlStatus(void)
 	{
@@ -340,32 +1068,129 @@ public:
 	/// Switch to enable location information in log messages
 	void enableLocation(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		locationEnabled = true;
 	}
 	/// Switch to disable location information in log messages
 	void disableLocation(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		locationEnabled = false;
 	}
 	/// Inspector to provide state information
 	bool getLocationStatus(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		return(locationEnabled);
 	}
 	///@}
 	
+	/// @name Asynchronous output
+	///
+	/// In async mode, entries are still formatted by the calling thread, but the finished record
+	/// is handed to a writer thread through a lock-free ring, so the caller never waits on cerr,
+	/// the log file, or other threads that are logging.  The scope, the sinks and the time
+	/// settings are read from a snapshot that is swapped in whole when they change, so
+	/// formatting and claiming the slot take no lock either.  Collapsing and binary sinks with
+	/// locations keep tables of what went before, so those entries still take one.  This needs
+	/// CONCURRENT_BOOST; without it the calls are accepted and output stays synchronous.
+	///@{
+	/// Start the writer thread
+	/// @param queueSize Most records that may be waiting to be written.  Rounded up to a power of two.
+	/// @param policy What to do with a new record when the queue is full
+	void enableAsync(const std::size_t queueSize=4096, const SlogOverflowPolicy policy=OVERFLOW_BLOCK);
+	/// Write out everything still queued, stop the writer thread and go back to synchronous output
+	void disableAsync(void);
+	/// Is a writer thread doing the output?
+	bool getAsyncStatus(void);
+	/// How many records have been thrown away by the overflow policy
+	unsigned long getDroppedCount(void);
+	/// Wait until every queued record has been written and flushed
+	void flush(void);
+	///@}
+	
+	/// @name Log file buffering
+	///
+	/// File sink output collects in a buffer and goes out in large writes rather than one
+	/// write(2) per line.  The buffer is written out when it gets big, when it has been
+	/// sitting for a while, right after an important entry, by flush() and at destruction.
+	/// The policy applies to the sinks the Slog has now and to later AddLogFileOutput() files.
+	///@{
+	/// @param bytes Write the buffer out once it holds this many bytes.  0 writes every entry.
+	/// @param seconds Write the buffer out once the oldest output in it is this old.  0 means no limit.
+	///        Without a writer thread, this is only checked when something gets logged.
+	/// @param level Write the buffer out straight after any entry at this level or lower (more important)
+	void setFlushPolicy(const std::size_t bytes=65536, const double seconds=1.0, const int level=LACONIC);
+	
+	/// \brief Rotate the log file by size or age.  See SlogFileSink::setRotation().
+	///
+	/// Also applies to files opened later by AddLogFileOutput().
+	void setRotation(const std::size_t bytes, const double seconds=0, const unsigned keep=5);
+	///@}
+	
+	/// @name Crash handling
+	///
+	/// Buffered and queued output is lost if the program dies on a fatal signal, because
+	/// the destructor never runs.  With the crash handler on, SIGSEGV, SIGBUS, SIGFPE, SIGILL
+	/// and SIGABRT first have every sink write out what it is holding, then the records
+	/// still queued for the writer thread, an ALWAYS entry naming the signal, the ends of
+	/// the open XML scopes and the closing </slogcxx>.  Files are fsync'ed.  After that the
+	/// signal goes on to the handler that was there before, usually the default one that
+	/// dumps core.  Only async-signal-safe calls are made, so a record another thread is
+	/// part way through writing when the signal hits can be lost or show up twice.  Not
+	/// available on WIN32.
+	///@{
+	/// Have the crash handler look after this Slog.  The handler is installed the first time.
+	void enableCrashHandler(void);
+	/// Stop looking after this Slog.  The destructor does this too.
+	void disableCrashHandler(void);
+	/// \brief What the crash handler does for this Slog, for a signal handler of your own
+	/// @param sig The signal to log
+	void crashFlush(const int sig);
+	///@}
+
+	/// @name Live reconfiguration
+	///
+	/// A config file can change a running program's logging without a restart.  Each line
+	/// is key = value.  Blank lines and lines starting with # are skipped.
+	/// \code
+	/// level = TRACE
+	/// level.net.rpc = BOMBASTIC
+	/// level.db = inherit
+	/// time = on
+	/// location = off
+	/// xml = on
+	/// collapse = off
+	/// file = /var/log/server.log
+	/// \endcode
+	/// A level is a number or LACONIC through BOMBASTIC, and level.<name> sets the level
+	/// of getLogger(name).  Flags are on/off, yes/no, true/false or 1/0.  An empty file
+	/// value drops the log file, and any other value opens it again in append mode, which
+	/// also gets you onto a fresh file after logrotate.  Settings that are not in the file
+	/// are left as they are.  Every line is checked before anything changes, so a bad or
+	/// half written file changes nothing.  A new log file is opened next, before any lock
+	/// is taken.  The settings are then applied as one change and published as one
+	/// snapshot, so no entry comes out with only some of them.  Threads that log meanwhile
+	/// carry on with the snapshot they have, and the old file gets what they queued.
+	///@{
+	/// \brief Read filename and change the settings to match
+	/// @return false if the file could not be read or has a bad line.  Either way gets an ALWAYS entry.
+	bool loadConfig(const std::string &filename);
+	/// \brief Load filename now, and again whenever it changes or the process gets a SIGHUP
+	///
+	/// A change is a new modification time, size or inode.  With CONCURRENT_BOOST a thread
+	/// looks every seconds.  Without it, or with seconds at 0, call pollConfig() from
+	/// somewhere that runs regularly, like a main loop.  The SIGHUP handler is installed
+	/// the first time and stays.  There is no SIGHUP on WIN32.  A reload does not hold up
+	/// logging threads, as with loadConfig().
+	void watchConfig(const std::string &filename, const double seconds=1.0);
+	/// Stop watching.  The destructor does this too.
+	void unwatchConfig(void);
+	/// \brief Reload the watched file if it changed or a SIGHUP came in since the last look
+	/// @return true if it was loaded again
+	bool pollConfig(void);
+	///@}
+
 	/// do one complete log. return true if logged.  This is the more traditionalC like interface
 	/// return false if there was some trouble
-	bool entry(const int lvl, const std::string str); 
+	bool entry(const int lvl, const std::string &str); 
 	
 	/// \brief Add a tag of where the log is being generated from.  Adds to the partial log message.
 	///
@@ -381,9 +1206,6 @@ public:
 	// The following messages are for controlling what the << log messages do
 	void setMsgLevel(const int lvl)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
 		assert(0<=lvl);
 		msgLevel=lvl;
 	}
@@ -395,20 +1217,12 @@ public:
 	/// Increase the log level for all messages following (less likely to be logged)
 	int incMsg(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		return ++msgLevel;
+		return msgLevel.add(1,INT_MIN);
 	}
 	/// Decrease the log level for all messages following (more likely to be logged)
 	int decMsg(void)
 	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		--msgLevel;
-		if (0>msgLevel) msgLevel=0;
-		return msgLevel;
+		return msgLevel.add(-1,0);
 	}
 	//@}
 	
@@ -419,7 +1233,11 @@ public:
 	///
 	/// FIX: maybe this should be some friend type thing, but me no like friends
 	/// @returns true if it added anything to the log message
-	bool partial(const int lvl, const std::string str); 
+	bool partial(const int lvl, const std::string &str); 
+	/// \brief add len characters of str to the current log without making a std::string first
+	bool partial(const int lvl, const char *str, const std::size_t len);
+	/// \brief The message this thread is building, for the operator<< template to format straight into
+	SlogBuffer partialBuffer(void);
 	/// Finish up a log entry after partials
 	/// @return False if there was no stored message to write to the log
 	bool complete(void);  
@@ -428,26 +1246,26 @@ public:
 	/// @name State stack handling
 	//@{
 	/// Change the indenting to a different string
-	void setStateIndent(const std::string &str)
-	{
-#ifdef CONCURRENT_BOOST
-		boost::mutex::scoped_lock lock(m_stateMutex);
-#endif
-		stateIndent=str;
-	}
+	void setStateIndent(const std::string &str);
 	/// What is the current indent string.
 	std::string getStateIndent(void)
 	{
-		return stateIndent;
+		return rootLog ? rootLog->getStateIndent() : stateIndent;
 	}
 	/// Return the string with the proper indenting
-	std::string indent(void);
+	const std::string &indent(void) const
+	{
+		return rootLog ? rootLog->indent() : indentPrefix;
+	}
 	/// Return a 2+ character scope depth
-	std::string getStateNumberStr(void);
-	std::string getCurScope(void)
+	const std::string &getStateNumberStr(void) const
+	{
+		return rootLog ? rootLog->getStateNumberStr() : depthLabel;
+	}
+	/// Return the name of the innermost scope, or an empty string outside of any scope
+	const std::string &getCurScope(void) const
 	{
-		if (0==getStateDepth()) return "";
-		return stateStack[stateStack.size()-1];
+		return rootLog ? rootLog->getCurScope() : curScope;
 	}
 	
 	/// Put the current scope onto the state stack
@@ -459,7 +1277,7 @@ public:
 	void writeState(bool flat=true);
 	int getStateDepth(void)
 	{
-		return stateStack.size();
+		return rootLog ? rootLog->getStateDepth() : stateStack.size();
 	}
 	//@}
 	
@@ -474,46 +1292,518 @@ public:
 		return *this;
 	}
 	
-	void SetLocation(const Where& w) { curLocation = w; }
+	/// \brief Attach a location to the message this thread is building
+	///
+	/// w is copied, so it can be a temporary.
+	void SetLocation(const Where& w) {
+		Accumulator &acc = accumulator();
+		acc.where = w;
+		acc.location = &acc.where;
+	}
+	/// Attach the location of a WHERE.  It lasts forever, so only a pointer is kept.
+	void SetLocation(const SlogSite& site) { accumulator().location = &site; }
 	
 private:
 #ifdef CONCURRENT_BOOST
-	boost::thread::id m_currentThread;	///< Boost thread ID for the thread that's current accumulating a msg
-	boost::mutex	m_outputMutex;		///< Boost mutex to protect the output stream(s) in this object
-	boost::mutex	m_stateMutex;		///< Boost mutex to protect state variables in this object
-	boost::mutex	m_accumulatorMutex;	///< Boost mutex to protect accumulating curStr in this object
+	boost::mutex	m_outputMutex;		///< Boost mutex held by changes, and by entries that collapse or define binary locations
+	boost::mutex	m_stateMutex;		///< Boost mutex to protect the scope stack and the other settings snapshots are made from
+	boost::mutex	m_sinkMutex;		///< Boost mutex held while the sinks are written to
+	boost::mutex	m_wakeMutex;		///< Boost mutex for the writer to sleep on
+	boost::condition_variable m_wake;	///< Signalled when a record is queued for a sleeping writer
+	boost::condition_variable m_queueDrained;	///< Signalled when the writer has written a batch
+	boost::thread	*m_writer;		///< Thread draining m_ring, if async
+	boost::atomic<bool> m_asyncEnabled;	///< Is output going through the ring?
+	boost::atomic<bool> m_writerStop;	///< Ask the writer thread to finish up
+	boost::atomic<bool> m_writerSleeping;	///< The writer is waiting on m_wake
+	boost::atomic<unsigned long> m_queued;	///< Ring slots ever claimed for records
+	boost::atomic<unsigned long> m_written;	///< Records ever taken out of the ring
+	boost::atomic<unsigned long> m_dropped;	///< Records thrown away by the overflow policy
+	boost::atomic<bool> m_crashed;		///< The crash handler has taken over the output
+	boost::mutex	m_levelMutex;		///< Boost mutex held while levels change, in the Slog at the top
+	boost::mutex	m_watchMutex;		///< Boost mutex held while starting and stopping the config watcher
+	boost::mutex	m_configMutex;		///< Boost mutex held while the config file is looked at and loaded
+	boost::condition_variable m_configWake;	///< Signalled to stop the config watcher
+	boost::thread	*m_configWatcher;	///< Thread calling pollConfig(), if any
+	bool		m_configStop;		///< Ask the config watcher to finish.  Guarded by m_configMutex.
+	double		m_configSeconds;	///< How often the config watcher looks
 #endif
-	int logLevel; ///< what the programs logging level is.  Turn this higher to get more messags
-	int msgLevel; ///< For partial messages, this is their default level
-	std::string curStr; ///< building the current message
-	bool xmlEnabled; ///< Should the output be to xml?
-	bool timeEnabled; ///< If true, then log entries should include a time stamp.
-	bool locationEnabled;	///< Flag: true => prefix location (if provided)
-	// FIX: how should time stamp formats be controlled?
+	// Read on every log statement, so these are never behind a lock
+	SlogAtomic<int> logLevel; ///< what the programs logging level is.  Turn this higher to get more messags
+	SlogAtomic<int> msgLevel; ///< For partial messages, this is their default level
+	SlogAtomic<bool> xmlEnabled; ///< Should the output be to xml?
+	SlogAtomic<bool> timeEnabled; ///< If true, then log entries should include a time stamp.
+	SlogAtomic<bool> locationEnabled;	///< Flag: true => prefix location (if provided)
 	
 	std::string stateIndent; ///< How much to indent the output for each level.
 	std::vector<std::string> stateStack; ///< All of the state names in a stack
+	// Kept up to date by pushState() and popState() so entries just copy them
+	std::string indentPrefix; ///< stateIndent once for each scope
+	std::string depthLabel; ///< Scope depth, padded to at least 2 characters
+	std::string curScope; ///< Name of the innermost scope
+	/// Redo depthLabel and curScope after the stack changes.  Caller handles locking.
+	void updateScopeCache(void);
 	std::vector<int> msgLvlStack; ///< for push and pop state
 	
-	std::ofstream logFile; ///< If open then also log to a file.
+	/// Not copyable.  The sinks belong to one Slog.
+	Slog(const Slog&);
+	
+	Slog *rootLog;		///< The Slog a named logger came from, or null for that Slog itself
+	Slog *parentLog;	///< The logger whose level this one follows, or null at the top
+	std::string name;	///< What getLogger() was asked for
+	bool levelSet;		///< Set by setLevel(), inc() or dec() rather than followed
+	std::map<std::string,Slog*> loggers;	///< Named loggers by name, at the top.  Owned.
+	/// A named logger for getLogger()
+	Slog(Slog *root, Slog *parent, const std::string &name);
+	/// The Slog at the top, which has the sinks and the scopes
+	Slog &root(void) {return rootLog ? *rootLog : *this;}
+	/// Bring every logger that follows a level up to date.  Caller holds m_levelMutex of the top Slog.
+	void passLevelsDown(void);
+	/// Keep track of the message level for a scope.  Caller holds m_stateMutex.
+	void pushMsgLevel(const int msgLvl);
+	/// Go back to the message level from before the scope.  Caller holds m_stateMutex.
+	void popMsgLevel(void);
+
+	std::string configFile;	///< The file watchConfig() is watching, or empty
+	SlogLongLong configStamp[3];	///< Modification time, size and inode of configFile when it was last looked at
+	long configHangups;	///< SIGHUPs seen by the last look
+#ifdef CONCURRENT_BOOST
+	/// Body of the config watcher thread
+	void configLoop(void);
+	/// Stop the config watcher thread.  Caller holds m_watchMutex.
+	void stopConfigWatcher(void);
+#endif
+
+	std::vector<SlogSink*> sinks;	///< Everywhere records go, as of the last change.  Owned.
+	std::vector<SlogSink*> writing;	///< The sinks records are written to right now.  Guarded by m_sinkMutex.
+	SlogSink *consoleSink;	///< The cerr sink from the constructor, if still there
+	SlogFileSink *fileSink;	///< The file sink from the constructor or AddLogFileOutput(), if any
+	
+	/*!
+	 \brief A change to the sinks, made by whoever writes the records
+	 
+	 With async output it goes through the ring like a record, so the writer makes it after
+	 the records that were formatted for the old sinks and before the ones formatted for the
+	 new.  Nobody has to wait for the queue to empty.
+	 */
+	struct SinkChange {
+		SinkChange() : swap(false) {}
+		bool swap;		///< Write to sinks from here on
+		std::vector<SlogSink*> sinks;	///< The new list, if swap
+		std::vector<std::pair<SlogSink*,SlogSinkFormat> > formats;	///< Sinks that switch format here
+		std::vector<std::pair<SlogSink*,std::string> > writes;	///< Text for one sink alone, like a new binary sink's definitions
+		std::vector<SlogSink*> dropped;	///< Sinks to flush and delete.  No snapshot may still have them.
+	};
+	/// A change that swaps in sinks as they are now
+	SinkChange *newSinkChange(void) const;
+	/// Make change after the records already written or queued.  Caller holds m_outputMutex and m_stateMutex.
+	void changeSinks(SinkChange *change);
+	/// Do what change says and delete it.  Caller holds m_sinkMutex.
+	void applySinkChange(SinkChange *change);
+	/// \brief Delete sinks once no logging thread can be looking at them
+	///
+	/// Caller holds m_outputMutex and m_stateMutex, and has published a snapshot without them.
+	void dropSinks(const std::vector<SlogSink*> &dropped);
+	/// The format sink will be in once the changes so far are made
+	SlogSinkFormat sinkFormat(const SlogSink *sink) const;
+	/// \brief Open filename as a file sink with the flush and rotation settings
+	///
+	/// Takes m_stateMutex only to copy the settings, so the file is opened without the locks
+	/// logging threads might need.
+	SlogFileSink *openLogFile(const std::string &filename, const bool append, const bool xml);
+	/// Drop the file sink, and put file in its place unless it is null.  The sink changes go
+	/// in change, and the old sink in dropped.  Caller is making a change.
+	void swapLogFile(SlogFileSink *file, SinkChange &change, std::vector<SlogSink*> &dropped);
+	/// Switch the file sink between XML and text.  Caller is making a change.
+	void setXml(const bool on, SinkChange &change);
+	
+	/*!
+	 \brief Everything an entry is formatted from, as it stood after a change
+	 
+	 Logging threads read the scope, the sinks and the time settings from here rather than
+	 from the members, so they need no lock.  A change makes a new one and publishes it
+	 with one pointer store.  A published one never changes, and it is only freed once no
+	 thread can still be reading it (see enter()).
+	 */
+	struct Snapshot {
+		unsigned long gen;	///< m_gen once it was published
+		std::string depthLabel;	///< depthLabel
+		std::string indent;	///< indentPrefix
+		std::string scope;	///< curScope
+		bool scoped;		///< Was there a scope?
+		std::size_t depth;	///< How many scopes
+		std::vector<SlogSink*> sinks;	///< sinks
+		std::vector<SlogSinkFormat> formats;	///< sinkFormat() of each of sinks
+		bool async;		///< Are records going through the ring?
+		bool collapse;		///< collapseEnabled
+		SlogTimeFormat timeFormat;	///< timeFormat
+		SlogClockSource clockSource;	///< clockSource
+		SlogLongLong clockOffset;	///< clockOffset
+	};
+#ifdef CONCURRENT_BOOST
+	boost::atomic<const Snapshot*> m_snapshot;	///< The latest settings
+	boost::atomic<unsigned long> m_gen;	///< Odd while a change is being made, and bumped to even when it is published
+	boost::atomic<unsigned long> m_epoch;	///< Moves on once nobody is reading from the epoch before
+	boost::atomic<unsigned> m_readers[2];	///< Threads reading a snapshot, by the parity of the epoch they came in at
+	std::vector<std::pair<const Snapshot*,unsigned long> > m_retired;	///< Old snapshots and m_epoch when they went.  Guarded by m_stateMutex.
+	/// Move m_epoch on if nobody is still reading from the one before.  @return false if somebody is
+	bool advanceEpoch(void);
+	/// Wait until every thread that was reading a snapshot has finished with it
+	void synchronize(void);
+#else
+	const Snapshot *m_snapshot;	///< The latest settings
+	unsigned long m_gen;	///< Odd while a change is being made
+#endif
+	/// \brief Start reading the latest snapshot
+	///
+	/// Nothing is locked.  The thread counts itself in for the current epoch, then reads
+	/// the snapshot.  A snapshot that has been replaced is freed after the epoch has moved
+	/// on twice, which it only does when nobody is left from the epoch before.  While a
+	/// change is being made this waits for it to be published.
+	/// @param epoch Set to what to hand leave()
+	const Snapshot &enter(unsigned long &epoch);
+	/// Done with the snapshot from enter()
+	void leave(const unsigned long epoch);
+	/// Reads a snapshot for as long as it is in scope
+	class SnapshotReader {
+	public:
+		explicit SnapshotReader(Slog &log) : log(log), epoch(0) {snap = &log.enter(epoch);}
+		~SnapshotReader() {log.leave(epoch);}
+		const Snapshot &get(void) const {return *snap;} ///< The snapshot
+	private:
+		SnapshotReader(const SnapshotReader&);		///< Not copyable
+		SnapshotReader &operator=(const SnapshotReader&);	///< Not copyable
+		Slog &log;		///< Whose snapshot
+		unsigned long epoch;	///< From enter()
+		const Snapshot *snap;	///< The snapshot being read
+	};
+	/// The latest snapshot, for a caller holding m_outputMutex, which keeps it from being replaced
+	const Snapshot &current(void) const;
+	/// Start a change.  Entries formatted from the snapshot until publish() are done again.
+	/// Caller holds m_outputMutex and m_stateMutex.
+	void beginChange(void);
+	/// Finish a change by publishing a snapshot of the settings as they are now.  Same locking.
+	void publish(void);
+	
+	std::size_t queueSize;	///< Capacity asked for
+	SlogOverflowPolicy overflowPolicy;	///< What to do when the ring is full
+#ifdef CONCURRENT_BOOST
+	/// A finished record waiting in a ring slot for the writer thread
+	struct PendingRecord {
+		int level;		///< Level the record was logged at
+		bool framing;		///< XML scope tag rather than an entry
+		SinkChange *change;	///< A change to the sinks rather than a record, or null
+		std::size_t len[SLOG_FORMAT_COUNT];	///< Length of the text for each format.  0 if not wanted.
+		std::string *overflow;	///< The texts, if they were too long for payload.  From m_pool.
+		char payload[SLOG_SLOT_PAYLOAD];	///< The texts one after another, if they fit
+	};
+	SlogRing<PendingRecord> *m_ring;	///< Records waiting for the writer thread
+	SlogRing<std::string*> *m_pool;	///< Spare strings for records that do not fit in a slot
+	
+	/// \brief Claim a ring slot, following the overflow policy if it is full
+	/// @param keep Never drop this one, since it is framing or a change
+	/// @return null if the record is dropped
+	SlogRing<PendingRecord>::Cell *claimSlot(const bool keep);
+	/// Make room by taking out the oldest record.  Framing and changes in it still get written
+	/// or made.  @return false if there was nothing to take out just now
+	bool dropOldest(void);
+	/// Put a record or a change in a slot from claimSlot() and let the writer have it
+	void fillSlot(SlogRing<PendingRecord>::Cell *cell, const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT],
+		      SinkChange *change=0);
+	/// \brief Copy the record out of cell and give the slot back.  Caller holds m_sinkMutex.
+	/// @return the change the slot held, or null if it held a record, which is now in text
+	SinkChange *takeSlot(SlogRing<PendingRecord>::Cell *cell, int &lvl, bool &framing, std::string text[SLOG_FORMAT_COUNT]);
+	/// Wait for the writer to write everything queued so far.  Caller must not hold m_sinkMutex.
+	void drainQueue(void);
+	/// A string from m_pool, or a new one if the pool is empty
+	std::string *spareString(void);
+	/// Put a string back in m_pool (or delete it if the pool is full).  Null is fine.
+	void recycle(std::string *str);
+	/// \brief Stop the writer and free the ring, once every queued record is written
+	///
+	/// Caller holds m_outputMutex and m_stateMutex, and has begun a change, so no thread can
+	/// claim a slot meanwhile.
+	void stopWriter(void);
+#endif
+	
+	std::size_t flushBytes;	///< Flush policy for file sinks.  See setFlushPolicy().
+	double flushSeconds;	///< Also how long the writer thread waits before flushing when idle
+	int flushLevel;		///< Flush policy for file sinks
+	std::size_t rotateBytes;	///< Rotation for the log file.  See setRotation().
+	double rotateSeconds;	///< Rotation for the log file
+	unsigned rotateKeep;	///< Rotation for the log file
+	
+	SlogAtomic<SlogTimeFormat> timeFormat;	///< How time stamps are written
+	SlogAtomic<SlogClockSource> clockSource;	///< Which clock time stamps come from
+	SlogLongLong clockOffset;	///< Microseconds added to the monotonic clock to line it up with the system clock
+	
+	struct Accumulator;
+	/// Read the clock snap says in microseconds since 1970
+	static SlogLongLong readClock(const Snapshot &snap);
+	/// Bring the calling thread's acc.timeText up to date with micros from readClock()
+	/// @return Length of the time stamp in acc.timeText
+	static std::size_t formatTime(Accumulator &acc, const SlogLongLong micros, const SlogTimeFormat format);
+	
+	/// Is any sink taking this format?  Caller holds m_stateMutex.
+	bool haveSink(const SlogSinkFormat format) const;
+	/// Which formats the sinks in snap want an entry at lvl in
+	/// @return false if no sink wants it
+	static bool wantedFormats(const Snapshot &snap, const int lvl, bool wanted[SLOG_FORMAT_COUNT]);
+	/// \brief Format an entry into text for each wanted format
+	///
+	/// Only uses snap and acc, so no lock is needed.
+	/// @param site Id from binaryLocation(), or 0
+	/// @param now Microseconds since 1970 from readClock(), or LLONG_MIN
+	void formatEntry(const Snapshot &snap, const bool wanted[SLOG_FORMAT_COUNT], const int lvl, const std::string &str,
+			 const bool binary, const Where *location, const unsigned site, const SlogLongLong now, Accumulator &acc,
+			 std::string text[SLOG_FORMAT_COUNT]) const;
+	
+	SlogAtomic<bool> collapseEnabled;	///< Count repeated entries rather than logging them
+	SlogULongLong lastHash;	///< Hash of the last entry logged, for collapsing
+	int lastLevel;		///< Level of the last entry logged
+	SlogLongLong lastTime;	///< When the last entry logged was logged
+	SlogLongLong lastRepeat;	///< When the last repeat of it came in
+	unsigned long repeats;	///< How many repeats are being held
+	/// Is this entry the same as the one before?  If so, count it.  Caller holds m_outputMutex.
+	bool collapse(const Snapshot &snap, const int lvl, const std::string &str, const bool binary, const Where *location,
+		      const SlogLongLong now);
+	/// Log the count of repeats being held, if any.  Caller holds m_outputMutex.
+	void flushRepeats(void);
+	/// Turn collapsing on or off, logging the repeats being held when it goes off.  Caller
+	/// is making a change.
+	void setCollapse(const bool on);
+	
+	SlogAtomic<bool> binaryArgs;	///< Build messages as binary arguments, because a sink wants FORMAT_BINARY
+	/// A call site that has been given an id for binary records
+	struct BinarySite {
+		const char *file;	///< What the definition record said
+		int lineno;		///< What the definition record said
+		const char *function;	///< What the definition record said
+		bool defined;		///< Has the definition gone out since the last binary sink was added?
+	};
+	std::map<const Where*,unsigned> siteIds;	///< Ids by WHERE object
+	std::vector<BinarySite> binarySites;	///< Index is the location id - 1
+	std::map<std::string,unsigned> scopeIds;	///< Scope names that have been given ids
+	std::vector<bool> scopeDefined;	///< Index is the scope id - 1.  Same idea as BinarySite::defined.
+	/// Append the definition of location if it needs one.  @return its id
+	unsigned binaryLocation(const Where &location, std::string &out);
+	/// Append a push record, plus the definition of the scope name if it needs one
+	void binaryPush(const std::string &scope, std::string &out);
+	/// Start a new binary sink off with the definitions it has not seen, written by change
+	void startBinarySink(SlogSink *sink, SinkChange &change);
+	/// Append an entry record.  str is tagged arguments if binary, otherwise plain text.
+	void binaryEntry(const int lvl, const SlogLongLong micros, const unsigned site,
+			 const std::string &str, const bool binary, std::string &out) const;
+	/// Format an entry that already passed the level check and send it out
+	/// @param binary str holds tagged binary arguments rather than text
+	/// @param location Where the entry came from, or null
+	bool output(const int lvl, const std::string &str, const bool binary, const Where *location);
+	/// \brief Send an entry formatted from snap to the sinks, either now or through the queue
+	/// @return false if a change came first, so it has to be formatted again
+	bool commit(const Snapshot &snap, const int lvl, const std::string text[SLOG_FORMAT_COUNT]);
+	/// Send a finished record to the sinks, either now or through the queue.  Caller holds
+	/// m_outputMutex, so no change can come in ahead of it.
+	void write(const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT]);
+	/// Hand one record to every sink being written to that wants it.  Caller holds m_sinkMutex.
+	void writeRecord(const int lvl, const bool framing, const std::string text[SLOG_FORMAT_COUNT]);
+	/// Flush every sink.  Caller holds m_sinkMutex.
+	void flushSinks(void);
+#ifdef CONCURRENT_BOOST
+	/// Body of the writer thread
+	void writerLoop(void);
+#endif
 	
-	/// \brief Format the current location information, if available
-	std::string& format_location(const bool xmlOutput) const;
-	Where	curLocation;	///< Current location, if set
+	/// What one thread keeps to itself: the message it is building with << and its last time stamp
+	struct Accumulator {
+		Accumulator() : level(0), binary(false), where("",0,""), location(0),
+			cachedSecond(LLONG_MIN), cachedFormat(TIME_EPOCH_MICROS), cachedLen(0) {}
+		std::string str;	///< building the current message
+		int level;		///< Level of the first piece of the message
+		bool binary;		///< str holds binary arguments rather than text
+		Where where;		///< Copy of the location given to SetLocation(const Where&)
+		const Where *location;	///< Current location, or null if none.  Either where or a SlogSite.
+		SlogLongLong cachedSecond;	///< The second that timeText currently holds
+		SlogTimeFormat cachedFormat;	///< The format timeText is in
+		std::size_t cachedLen;	///< Length of the seconds part of timeText
+		char timeText[SLOG_TIME_BUFSIZE];	///< Last time stamp.  Only the microseconds change within a second.
+	};
+	/// Start a new message off at lvl if acc is empty
+	void startMessage(Accumulator &acc, const int lvl) const
+	{
+		if (!acc.str.empty()) return;
+		acc.level = lvl;
+		acc.binary = rootLog ? rootLog->binaryArgs : binaryArgs;
+	}
+#ifdef CONCURRENT_BOOST
+	/// Each thread builds its own message, so threads only meet in complete()
+	boost::thread_specific_ptr<Accumulator> m_accumulator;
+#else
+	Accumulator accum;	///< The message being built
+#endif
+	/// The message the calling thread is building
+	Accumulator &accumulator(void)
+	{
+#ifdef CONCURRENT_BOOST
+		Accumulator *acc = m_accumulator.get();
+		if (!acc) {
+			acc = new Accumulator;
+			m_accumulator.reset(acc);
+		}
+		return *acc;
+#else
+		return accum;
+#endif
+	}
 }; // end Slog class
 
 
+//////////////////////////////////////////////////////////////////////
+// Number formatting
+//////////////////////////////////////////////////////////////////////
+
+/// Big enough for anything the slogFormat functions write, sign and terminating nul included
+#define SLOG_NUMBER_BUFSIZE 32
+
+/// @name Number formatting for the operator<< overloads
+///
+/// These write into buf without allocating anything and return the number of characters
+/// written (buf is also nul terminated).  buf must hold SLOG_NUMBER_BUFSIZE characters.
+/// Integers never look at the locale.  Floating point values are written with the fewest
+/// digits that still read back as exactly the same value.
+//@{
+std::size_t slogFormatSigned(char *buf, const SlogLongLong v);		///< Signed integers
+std::size_t slogFormatUnsigned(char *buf, const SlogULongLong v);	///< Unsigned integers
+std::size_t slogFormatDouble(char *buf, const double v);		///< 8 byte floats, up to 17 digits
+std::size_t slogFormatFloat(char *buf, const float v);			///< 4 byte floats, up to 9 digits
+//@}
+
+/// Microseconds since 1970 as text in format, with micros from Slog or a binary record
+std::size_t slogFormatTime(char *buf, const SlogLongLong micros, const SlogTimeFormat format);
+
+//////////////////////////////////////////////////////////////////////
+// Record formatting
+//////////////////////////////////////////////////////////////////////
+
+/// \brief The pieces of one entry, ready to be formatted
+///
+/// Slog fills this in from its own state, and SlogDecoder from binary records,
+/// so both write exactly the same text.
+struct SlogEntry {
+	const char *time;	///< Time stamp, if timeLen is not 0
+	std::size_t timeLen;	///< Length of time
+	const Where *location;	///< Where the entry came from, or null
+	const std::string *message;	///< The entry itself
+	const std::string *depthLabel;	///< Scope depth padded to 2 characters.  See slogDepthLabel().
+	const std::string *indent;	///< Indent for the scope depth
+	const std::string *scope;	///< Name of the innermost scope, or null outside of any scope
+};
+
+/// Append entry to out in one of the text formats, newline included
+void slogFormatEntry(const SlogSinkFormat format, const SlogEntry &entry, std::string &out);
+/// Append the location, as XML or as (file:line:function)
+void slogFormatLocation(std::string &out, const Where &location, const bool xml);
+/// Set out to the scope depth, padded to at least 2 characters
+void slogDepthLabel(const std::size_t depth, std::string &out);
+/// Append the XML tag for going into a scope
+void slogFormatScopeStart(const std::string &indent, const std::string &name, std::string &out);
+/// Append the XML tag for leaving a scope
+void slogFormatScopeEnd(const std::string &indent, const std::string &name, std::string &out);
+/// Append the text that binary arguments stand for.  @return false if args is damaged.
+bool slogDecodeArgs(const char *args, const std::size_t len, std::string &out);
+
+/*!
+ \brief Turn FORMAT_BINARY records back into text or XML
+
+ Feed it the bytes of a binary log in pieces of any size.  It writes what the
+ same entries would have looked like coming out of a text, console or XML sink.
+ \code
+ SlogDecoder decoder(FORMAT_XML);
+ std::string text;
+ while (in.read(buf,sizeof(buf)) || in.gcount()) {
+	 if (!decoder.decode(buf,in.gcount(),text)) break; // Damaged
+	 std::cout << text;
+	 text.clear();
+ }
+ decoder.finish(text);
+ \endcode
+ */
+class SlogDecoder {
+public:
+	/// @param format What to turn the records into.  Not FORMAT_BINARY.
+	/// @param timeFormat How to write time stamps
+	/// @param indentStr Indent for each scope, like the Slog constructor's
+	SlogDecoder(const SlogSinkFormat format=FORMAT_TEXT, const SlogTimeFormat timeFormat=TIME_EPOCH_MICROS,
+		    const std::string &indentStr=" ");
+	/// \brief Append the text for the complete records in data to out
+	///
+	/// A record split across calls is held until the rest of it arrives.
+	/// @return false if the data is not a slogcxx binary log or is damaged
+	bool decode(const char *data, const std::size_t len, std::string &out);
+	/// Append whatever closes the output, such as </slogcxx>
+	void finish(std::string &out);
+private:
+	/// Handle one record.  @return false if it is damaged
+	bool record(const char type, const char *payload, const std::size_t len, std::string &out);
+	/// A call site from a definition record
+	struct Site {
+		std::string file;	///< File name
+		int lineno;		///< Line number
+		std::string function;	///< Function name
+	};
+	SlogSinkFormat format;	///< What to write
+	SlogTimeFormat timeFormat;	///< How to write time stamps
+	std::string stateIndent;	///< Indent for each scope
+	std::string pending;	///< Start of a record that has not all arrived
+	bool started;		///< Has a header been seen?
+	std::map<unsigned,Site> sites;	///< Call sites by id
+	std::map<unsigned,std::string> scopes;	///< Scope names by id
+	std::vector<std::string> stack;	///< Names of the scopes we are in
+	std::string indent;	///< stateIndent once for each scope
+	std::string depthLabel;	///< Scope depth, padded
+};
+
 Slog& operator<<(Slog&s, Slog&(*manip)(Slog&));		//!< Allow the use of iomanipulators
 Slog& operator<<(Slog& s, const LogLevelsEnum e);	//!< Set message log level for this message
 
+/// \brief Where the rest of a statement goes when its level is over SLOGCXX_MAX_LEVEL
+///
+/// Every << is an empty inline template, so the rest of the statement leaves no code behind.  As with
+/// NLOG, operands with side effects are still evaluated.
+class SlogNull {
+public:
+	/// Swallow anything
+	template <typename T>
+	SlogNull &operator<<(UNUSED const T &v) {return *this;}
+	/// Swallow endl and the other manipulators
+	SlogNull &operator<<(UNUSED Slog&(*manip)(Slog&)) {return *this;}
+};
+
+/// @cond
+/// Carry on with the Slog when the level is compiled in, or with a SlogNull when it is not
+template <bool Kept> struct SlogKeep {
+	typedef Slog &stream;
+	static Slog &start(Slog &s, const int lvl) {return s << LogLevelsEnum(lvl);}
+};
+template <> struct SlogKeep<false> {
+	typedef SlogNull &stream;
+	static SlogNull &start(Slog &s, const int lvl) {
+		s.setMsgLevel(lvl); // Sticks for the statements after, as it would if compiled in
+		static SlogNull nowhere;
+		return nowhere;
+	}
+};
+/// @endcond
+
+/// Set the message level, or throw away the rest of the statement if Lvl is not compiled in
+template <int Lvl>
+inline typename SlogKeep<(Lvl<=SLOGCXX_MAX_LEVEL)>::stream operator<< (Slog &s, SlogLevel<Lvl>) {
+	return SlogKeep<(Lvl<=SLOGCXX_MAX_LEVEL)>::start(s,Lvl);
+}
+
 Slog& endl(Slog& s); //!< endl terminates a log... similar to std::endl
 Slog& decl(Slog& s); //!< make the message MORE likely to show up
 Slog& incl(Slog& s); //!< make the message LESS likely to show up
 
-// Logging operators for basic types
-Slog& operator<< (Slog &s, const int &r); //!< Allow logging of ints
-Slog& operator<< (Slog &s, const unsigned int &r); //!< Allow logging of unsigned ints
-Slog& operator<< (Slog &s, const size_t &r); //!< 32/64 bit safe unsigned numbers
+// Logging operators for strings.  Numbers and your own types go through the template below.
 Slog& operator<< (Slog &s, const char *str); //!< Allow logging of C strings
 Slog& operator<< (Slog &s, const std::string &str); //!< Log a string
 
@@ -532,17 +1822,118 @@ Slog& operator<< (Slog &s, const std::string &str); //!< Log a string
 //int foo(Slog &s);
 //int foo(Slog *s);
 
-Slog& operator<< (Slog &s, const char &c); //!<  Log insertion of a single character
-Slog& operator<< (Slog &s, const short &sh); //!< Insert a short integer
-Slog& operator<< (Slog &s, const long &l); //!< Insert a long integer
-//Slog& operator<< (Slog &s, const long long &ll); //!< Insert a long long character
-Slog& operator<< (Slog &s, const float &f); //!< Insert a 4 byte float
-Slog& operator<< (Slog &s, const double &d); //!< Insert a 8 byte float
+/// \brief What SlogTraits<T>::format writes into: the message the current thread is building
+///
+/// Appending here is appending to the log message itself, so there is no temporary string.
+class SlogBuffer {
+public:
+	/// Wrap the message being built
+	/// @param binary Append tagged binary arguments (see SlogBinaryArg) rather than text
+	explicit SlogBuffer(std::string &message, const bool binary=false) : buf(message), binary(binary) {}
+	/// Some characters
+	void append(const char *str, const std::size_t len) {
+		if (binary) {
+			if (!len) return; // Same as text, where nothing is nothing
+			const unsigned n = static_cast<unsigned>(len);
+			appendTagged(SLOG_ARG_STRING,&n,sizeof(n));
+		}
+		buf.append(str,len);
+	}
+	void append(const char *str) {append(str,strlen(str));} ///< A C string
+	void append(const std::string &str) {append(str.data(),str.size());} ///< A C++ string
+	void append(const char c) {if (binary) append(&c,1); else buf.push_back(c);} ///< One character
+	/// Signed integer as decimal text
+	void appendSigned(const SlogLongLong v) {
+		if (binary) {appendTagged(SLOG_ARG_SIGNED,&v,sizeof(v)); return;}
+		char tmp[SLOG_NUMBER_BUFSIZE]; buf.append(tmp,slogFormatSigned(tmp,v));
+	}
+	/// Unsigned integer as decimal text
+	void appendUnsigned(const SlogULongLong v) {
+		if (binary) {appendTagged(SLOG_ARG_UNSIGNED,&v,sizeof(v)); return;}
+		char tmp[SLOG_NUMBER_BUFSIZE]; buf.append(tmp,slogFormatUnsigned(tmp,v));
+	}
+	/// Shortest text that reads back as the same double
+	void appendDouble(const double v) {
+		if (binary) {appendTagged(SLOG_ARG_DOUBLE,&v,sizeof(v)); return;}
+		char tmp[SLOG_NUMBER_BUFSIZE]; buf.append(tmp,slogFormatDouble(tmp,v));
+	}
+	/// Shortest text that reads back as the same float
+	void appendFloat(const float v) {
+		if (binary) {appendTagged(SLOG_ARG_FLOAT,&v,sizeof(v)); return;}
+		char tmp[SLOG_NUMBER_BUFSIZE]; buf.append(tmp,slogFormatFloat(tmp,v));
+	}
+private:
+	/// Tag byte, then the raw bytes of the value
+	void appendTagged(const char tag, const void *v, const std::size_t len) {
+		buf.push_back(tag);
+		buf.append(static_cast<const char *>(v),len);
+	}
+	std::string &buf; ///< The message being built
+	bool binary;	///< Raw arguments rather than text
+};
+
+/// SlogTraits for the signed integer types
+template <typename T> struct SlogSignedTraits : SlogInsertable {
+	static void format(SlogBuffer &buf, const T v) {buf.appendSigned(v);} ///< Decimal text
+};
+/// SlogTraits for the unsigned integer types
+template <typename T> struct SlogUnsignedTraits : SlogInsertable {
+	static void format(SlogBuffer &buf, const T v) {buf.appendUnsigned(v);} ///< Decimal text
+};
+/// SlogTraits for the character types, which log as characters rather than numbers
+template <typename T> struct SlogCharTraits : SlogInsertable {
+	static void format(SlogBuffer &buf, const T v) {buf.append(static_cast<char>(v));} ///< The character
+};
+
+/// @cond
+template <> struct SlogTraits<char> : SlogCharTraits<char> {};
+template <> struct SlogTraits<signed char> : SlogCharTraits<signed char> {};
+template <> struct SlogTraits<unsigned char> : SlogCharTraits<unsigned char> {};
+template <> struct SlogTraits<short> : SlogSignedTraits<short> {};
+template <> struct SlogTraits<int> : SlogSignedTraits<int> {};
+template <> struct SlogTraits<long> : SlogSignedTraits<long> {};
+template <> struct SlogTraits<SlogLongLong> : SlogSignedTraits<SlogLongLong> {};
+template <> struct SlogTraits<unsigned short> : SlogUnsignedTraits<unsigned short> {};
+template <> struct SlogTraits<unsigned int> : SlogUnsignedTraits<unsigned int> {};
+template <> struct SlogTraits<unsigned long> : SlogUnsignedTraits<unsigned long> {};
+template <> struct SlogTraits<SlogULongLong> : SlogUnsignedTraits<SlogULongLong> {};
+template <> struct SlogTraits<bool> : SlogInsertable {
+	static void format(SlogBuffer &buf, const bool v) {buf.append(v ? '1' : '0');}
+};
+template <> struct SlogTraits<float> : SlogInsertable {
+	static void format(SlogBuffer &buf, const float v) {buf.appendFloat(v);}
+};
+template <> struct SlogTraits<double> : SlogInsertable {
+	static void format(SlogBuffer &buf, const double v) {buf.appendDouble(v);}
+};
+template <> struct SlogTraits<long double> : SlogInsertable {
+	static void format(SlogBuffer &buf, const long double v) {buf.appendDouble(static_cast<double>(v));}
+};
+/// @endcond
+
+/// \brief Log anything that has a SlogTraits specialization: all the numbers plus your own types
+///
+/// Checks the message level before any formatting happens, then formats straight into the
+/// message.  For types without a SlogTraits the return type does not exist, so this template
+/// drops out and the other operator<< overloads get a chance.
+inline SlogBuffer Slog::partialBuffer(void) {
+	Accumulator &acc = accumulator();
+	startMessage(acc,msgLevel);
+	return SlogBuffer(acc.str,acc.binary);
+}
 
-Slog& operator<< (Slog &s, const unsigned short &ush); //!< Insert an unsigned short integer
+template <typename T>
+inline typename SlogTraits<T>::result_type operator<< (Slog &s, const T &v) {
+	if (!s.isEnabled()) return s; // Do not bother formatting what will be thrown away
+	SlogBuffer buf(s.partialBuffer());
+	SlogTraits<T>::format(buf,v);
+	return s;
+}
 
 ////// More complicated insertions of non-basic types.
 Slog& operator<< (Slog &s, const Where &w); //!< Insert where object
+Slog& operator<< (Slog &s, const SlogSite &site); //!< Insert the where object of a WHERE
+Slog& operator<< (Slog &s, const SlogLimited &limited); //!< Count of records SLOG_RATE or SLOG_SAMPLE held back
 
 
 /// @brief Put this sucker on the stack to save your state.